@@ -228,12 +228,17 @@ static void sim5320_handler(void * param)
 static void netw_con_handler(void)
 {
     sim5320_state_t read_res;
-    char buf[128];
     
      switch(act_task_state) {
         case 0:
-            sprintf(buf,"AT+CGSOCKCONT=1,\"IP\",\"%s\"\r\n" , last_param1);
-            serial_send_force(SIM5320_DRV, buf, SERIAL_SEND_STRING);
+        {
+            hw_iovec_t cmd[] = {
+                HW_IOVEC_STR("AT+CGSOCKCONT=1,\"IP\",\""),
+                {last_param1, strlen(last_param1)},
+                HW_IOVEC_STR("\"\r\n"),
+            };
+            serial_sendv(SIM5320_DRV, cmd, sizeof(cmd) / sizeof(cmd[0]));
+        }
             act_task_state++;
             break;
         case 1:
@@ -354,12 +359,19 @@ static void netw_leave_handler(void)
 static void tcp_con_handler(void)
 {
     sim5320_state_t read_res;
-    char buf[128];
     
      switch(act_task_state) {
         case 0:
-            sprintf(buf,"AT+CIPOPEN=0,\"TCP\",\"%s\",%s\r\n", last_param1, last_param2);
-            serial_send_force(SIM5320_DRV, buf, SERIAL_SEND_STRING);
+        {
+            hw_iovec_t cmd[] = {
+                HW_IOVEC_STR("AT+CIPOPEN=0,\"TCP\",\""),
+                {last_param1, strlen(last_param1)},
+                HW_IOVEC_STR("\","),
+                {last_param2, strlen(last_param2)},
+                HW_IOVEC_STR("\r\n"),
+            };
+            serial_sendv(SIM5320_DRV, cmd, sizeof(cmd) / sizeof(cmd[0]));
+        }
             act_task_state++;
             break;
         case 1:
@@ -425,7 +437,7 @@ static void tcp_transf_handler(void)
     hw_res_t read_res;
     char buf[256];
     int32_t len;
-    static uint8_t recp = 0;
+    static uint16_t recp = 0;
     
     switch(act_task_state) {
         case 0: /*Send data length*/
@@ -462,10 +474,7 @@ static void tcp_transf_handler(void)
             break;
         case 3: /*Wait for +IPD */
             if(read_line() == SIM5320_STATE_OK) {
-                if(line_buf[0] == '+' &&
-                   line_buf[1] == 'I' &&
-                   line_buf[2] == 'P' &&
-                   line_buf[3] == 'D') {
+                if(strncmp(line_buf, "+IPD", 4) == 0) {
                     sscanf(&line_buf[4], "%d", &transf_size);
                     SMSG("Rec. length: %d", transf_size);
                     transf_buf[0] = transf_size & 0xFF;
@@ -481,21 +490,13 @@ static void tcp_transf_handler(void)
             break;
        
         case 4: /*Receiving data*/
-            while(1) {
-                len = 1;
-                read_res = serial_rec(SIM5320_DRV, &transf_buf[recp], &len); 
-                if(read_res == HW_RES_OK && len == 1) {
-                    if(recp >= transf_size + 1) {
-                        SMSG("Data received");
-                        act_task = SIM5320_TASK_NONE;
-                        if(act_cb != NULL) act_cb(SIM5320_STATE_OK, (char *)transf_buf);
-                        break;
-                    } else {
-                        recp++;
-                    }
-                } else {
-                    break;
-                }
+            len = transf_size + 2 - recp;
+            serial_rec(SIM5320_DRV, &transf_buf[recp], &len); 
+            recp += len;
+            if(recp >= transf_size + 2) {
+                SMSG("Data received");
+                act_task = SIM5320_TASK_NONE;
+                if(act_cb != NULL) act_cb(SIM5320_STATE_OK, (char *)transf_buf);
             }
             break;
             
@@ -511,45 +512,40 @@ static sim5320_state_t read_line(void)
 {   
     hw_res_t res;
     int32_t length;
-    while(line_i < sizeof(line_buf)) {
-        length = 1;
-        res = serial_rec(SIM5320_DRV, &line_buf[line_i], &length);
-        if(res == HW_RES_OK && length == 1) {
-            /*Ignore leading '\r' and '\n'*/
-            if(line_i != 0 || (line_buf[0] != '\n' && line_buf[0] != '\r')) 
-            {
-//                char buf[2];
-//                buf[0] = line_buf[line_i];
-//                buf[1] = '\0';
-//                SMSG("%s", buf);
-                
-                line_i ++;
-
-                /*Check line ending*/
-                if(line_i >= 2) {
-                    if(line_buf[line_i - 1] == '\n' &&
-                       line_buf[line_i - 2] == '\r') 
-                    {
-                        line_buf[line_i] = '\0';   /*Close the sting*/
-                        line_i = 0;
-#if SIM5320_LOG_REC_LINES != 0
-                        SMSG("Line received: %s", line_buf);
-#endif
-                        return SIM5320_STATE_OK;
-                    }
-                }
-            }
-        } else {
+    uint16_t skip;
+    
+    while(1) {
+        length = sizeof(line_buf) - 1 - line_i;    /*Keep place for the closing '\0'*/
+        res = serial_rec_until(SIM5320_DRV, &line_buf[line_i], &length, "\r\n", 2);
+        line_i += length;
+        
+        if(res == HW_RES_EMPTY) {
+            /*Only a part of the line is received*/
+            if(length != 0) continue;
+            return SIM5320_STATE_BUSY;
+        } else if(res != HW_RES_OK) {
+            SWARN("Overflow");
+            line_i = 0;
             return SIM5320_STATE_BUSY;
         }
-    }
-    
-    if(line_i == sizeof(line_buf)) {
-        SWARN("Overflow");
+        
+        line_buf[line_i] = '\0';   /*Close the sting*/
+        
+        /*Ignore leading '\r' and '\n'*/
+        skip = 0;
+        while(line_buf[skip] == '\r' || line_buf[skip] == '\n') skip++;
+        if(skip == line_i) {
+            line_i = 0;     /*Empty line*/
+            continue;
+        }
+        if(skip != 0) memmove(line_buf, &line_buf[skip], line_i - skip + 1);
         line_i = 0;
+        
+#if SIM5320_LOG_REC_LINES != 0
+        SMSG("Line received: %s", line_buf);
+#endif
+        return SIM5320_STATE_OK;
     }
-    
-    return SIM5320_STATE_BUSY;
 }
 
 #endif  /*USE_SIM5320 != 0*/
\ No newline at end of file
@@ -27,7 +27,7 @@
 /**********************
  *  STATIC PROTOTYPES
  **********************/
-static void log_wr(const char * txt);
+static void log_wr(const char * sym, const char * path, const char * func_name, const char * txt);
 
 /**********************
  *  STATIC VARIABLES
@@ -73,13 +73,7 @@ void log_msg(const char * path, const char * func_name, const char * format, ...
 	vsprintf(buf,format, va);
 	va_end(va);
 
-	log_wr(LOG_SYM_MSG);
-	log_wr(path);
-	log_wr("/");
-	log_wr(func_name);
-	log_wr(": ");
-	log_wr(buf);
-	log_wr("\r\n");
+	log_wr(LOG_SYM_MSG, path, func_name, buf);
 #endif
 }
 
@@ -101,13 +95,7 @@ void log_warn(const char * path, const char * func_name, const char * format, ..
 	vsprintf(buf,format,va);
 	va_end(va);
 
-	log_wr(LOG_SYM_WARN);
-	log_wr(path);
-	log_wr("/");
-	log_wr(func_name);
-	log_wr(": ");
-	log_wr(buf);
-	log_wr("\r\n");
+	log_wr(LOG_SYM_WARN, path, func_name, buf);
 #endif
 }
 
@@ -128,13 +116,7 @@ void log_err(const char * path, const char * func_name, const char * format, ...
 	vsprintf(buf,format,va);
 	va_end(va);
 
-	log_wr(LOG_SYM_ERR);
-	log_wr(path);
-	log_wr("/");
-	log_wr(func_name);
-	log_wr(": ");
-	log_wr(buf);
-	log_wr("\r\n");
+	log_wr(LOG_SYM_ERR, path, func_name, buf);
 #endif
 }
 
@@ -145,17 +127,30 @@ void log_err(const char * path, const char * func_name, const char * format, ...
  **********************/
 
 /**
- * Write out a log
- * @param txt
+ * Write out a log as one message
+ * @param sym symbol of the log level (LOG_SYM_...)
+ * @param path path or file name of file where the log occurred
+ * @param func_name name of the function where the log occurred
+ * @param txt the formatted log text
  */
-static void log_wr(const char * txt)
+static void log_wr(const char * sym, const char * path, const char * func_name, const char * txt)
 {
 #if LOG_USE_SERIAL != 0
-    serial_send_force(LOG_SERIAL_DRV, txt, strlen(txt));
+    /*Send the parts together to not mix them with other messages*/
+    hw_iovec_t iov[] = {
+        {sym, strlen(sym)},
+        {path, strlen(path)},
+        HW_IOVEC_STR("/"),
+        {func_name, strlen(func_name)},
+        HW_IOVEC_STR(": "),
+        {txt, strlen(txt)},
+        HW_IOVEC_STR("\r\n"),
+    };
+    serial_sendv(LOG_SERIAL_DRV, iov, sizeof(iov) / sizeof(iov[0]));
 #endif
 
 #if LOG_USE_PRINTF != 0
-    printf(txt);
+    printf("%s%s/%s: %s\r\n", sym, path, func_name, txt);
 #endif
 }
 
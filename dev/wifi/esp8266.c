@@ -343,12 +343,19 @@ static void netw_list_handler(void)
 static void netw_con_handler(void)
 {
     esp8266_state_t read_res;
-    char buf[128];
     
      switch(act_task_state) {
         case 0:
-            sprintf(buf,"AT+CWJAP=\"%s\",\"%s\"\r\n" , last_param1, last_param2);
-            serial_send_force(ESP8266_DRV, buf, SERIAL_SEND_STRING);
+        {
+            hw_iovec_t cmd[] = {
+                HW_IOVEC_STR("AT+CWJAP=\""),
+                {last_param1, strlen(last_param1)},
+                HW_IOVEC_STR("\",\""),
+                {last_param2, strlen(last_param2)},
+                HW_IOVEC_STR("\"\r\n"),
+            };
+            serial_sendv(ESP8266_DRV, cmd, sizeof(cmd) / sizeof(cmd[0]));
+        }
             act_task_state++;
             break;
         case 1:
@@ -484,8 +491,16 @@ static void tcp_con_handler(void)
     
      switch(act_task_state) {
         case 0:
-            sprintf(buf, "AT+CIPSTART=\"TCP\",\"%s\",%s\r\n", last_param1, last_param2);
-            serial_send_force(ESP8266_DRV, buf, SERIAL_SEND_STRING);
+        {
+            hw_iovec_t cmd[] = {
+                HW_IOVEC_STR("AT+CIPSTART=\"TCP\",\""),
+                {last_param1, strlen(last_param1)},
+                HW_IOVEC_STR("\","),
+                {last_param2, strlen(last_param2)},
+                HW_IOVEC_STR("\r\n"),
+            };
+            serial_sendv(ESP8266_DRV, cmd, sizeof(cmd) / sizeof(cmd[0]));
+        }
             act_task_state++;
             break;
         case 1:
@@ -569,7 +584,7 @@ static void tcp_transf_handler(void)
     hw_res_t read_res;
     char buf[256];
     int32_t len;
-    static uint8_t recp = 0;
+    static uint16_t recp = 0;
     
      switch(act_task_state) {
         case 0: /*Send data length*/
@@ -624,77 +639,52 @@ static void tcp_transf_handler(void)
             } 
             break;
          case 4: /*Wait for +IPD, */
-            while(1) {
-                len = 1;
-                read_res = serial_rec(ESP8266_DRV, &transf_buf[recp], &len);
-                if(read_res == HW_RES_OK && len == 1) {
-                    recp ++;
-                    transf_buf[recp] = '\0';
-                    if(strcmp(transf_buf, "\r\n+IPD,") == 0) {
-                        SMSG("+IPD ok");
-                        recp = 0;
-                        act_task_state ++;
-                        break;
-                    } else if(recp > 50) {
-                        SWARN("No +IPD received");
-                        act_task = ESP8266_TASK_NONE;
-                        if(act_cb != NULL) act_cb(ESP8266_STATE_ERROR, "Error while receiving answer");
-                        break;
-                    }
-                } else {
-                    break;
-                }
+            len = 50 - recp + 5;     /*Accept max. 50 bytes before "+IPD,"*/
+            read_res = serial_rec_until(ESP8266_DRV, buf, &len, "+IPD,", 5);
+            recp += len;
+            if(read_res == HW_RES_OK) {
+                SMSG("+IPD ok");
+                recp = 0;
+                act_task_state ++;
+            } else if(read_res != HW_RES_EMPTY) {
+                SWARN("No +IPD received");
+                act_task = ESP8266_TASK_NONE;
+                if(act_cb != NULL) act_cb(ESP8266_STATE_ERROR, "Error while receiving answer");
             }
             break;
             
          case 5: /*Receiving data length*/
-            while(1) {
-                len = 1;
-                read_res = serial_rec(ESP8266_DRV, &transf_buf[recp], &len);
-                if(read_res == HW_RES_OK && len == 1) {
-                    if(transf_buf[recp] == ':') {
-                        transf_buf[recp + 1] = '\0'; 
-                        sscanf(transf_buf, "%d", &transf_size);
-                        SMSG("Rec. length: %d", transf_size);
-                        if(transf_size > ESP8266_BUF_SIZE) {
-                            SWARN("Too long data: %d", transf_size);
-                            act_task = ESP8266_TASK_NONE;
-                            if(act_cb != NULL) act_cb(ESP8266_STATE_ERROR, "Too long data");
-                        } else {
-                            transf_buf[0] = (uint8_t) transf_size & 0xFF;    /*Save the data length*/ 
-                            transf_buf[1] = (uint8_t) (transf_size >> 8) & 0xFF;
-                            recp = 2;
-                            act_task_state ++;
-                            break;
-                        }
-                    } else if(recp > 8) {
-                        SWARN("No answ. length received");
-                        act_task = ESP8266_TASK_NONE;
-                        if(act_cb != NULL) act_cb(ESP8266_STATE_ERROR, "Too long length info");
-                        break;
-                    }
-                    recp ++;
+            len = 10 - recp;
+            read_res = serial_rec_until(ESP8266_DRV, &transf_buf[recp], &len, ":", 1);
+            recp += len;
+            if(read_res == HW_RES_OK) {
+                transf_buf[recp] = '\0'; 
+                sscanf(transf_buf, "%d", &transf_size);
+                SMSG("Rec. length: %d", transf_size);
+                if(transf_size > ESP8266_BUF_SIZE - 2) {     /*The first 2 bytes store the length*/
+                    SWARN("Too long data: %d", transf_size);
+                    act_task = ESP8266_TASK_NONE;
+                    if(act_cb != NULL) act_cb(ESP8266_STATE_ERROR, "Too long data");
                 } else {
-                    break;
+                    transf_buf[0] = (uint8_t) transf_size & 0xFF;    /*Save the data length*/ 
+                    transf_buf[1] = (uint8_t) (transf_size >> 8) & 0xFF;
+                    recp = 2;
+                    act_task_state ++;
                 }
+            } else if(read_res != HW_RES_EMPTY) {
+                SWARN("No answ. length received");
+                act_task = ESP8266_TASK_NONE;
+                if(act_cb != NULL) act_cb(ESP8266_STATE_ERROR, "Too long length info");
             }
             break;
          case 6: /*Receiving data*/
-            while(1) {
-                len = 1;
-                read_res = serial_rec(ESP8266_DRV, &transf_buf[recp], &len); 
-                if(read_res == HW_RES_OK && len == 1) {
-                    if(recp >= transf_size + 1) {
-                        SMSG("Data received");
-                        act_task = ESP8266_TASK_NONE;
-                        if(act_cb != NULL) act_cb(ESP8266_STATE_OK, (char *)transf_buf);
-                        break;
-                    } else {
-                        recp++;
-                    }
-                } else {
-                    break;
-                }
+            len = transf_size + 2 - recp;
+            serial_rec(ESP8266_DRV, &transf_buf[recp], &len); 
+            recp += len;
+            if(recp >= transf_size + 2) {
+                SMSG("Data received");
+                act_task = ESP8266_TASK_NONE;
+                if(act_cb != NULL) act_cb(ESP8266_STATE_OK, (char *)transf_buf);
             }
             break;
      }
@@ -728,44 +718,39 @@ static esp8266_state_t read_line(void)
 {   
     hw_res_t res;
     int32_t length;
-    while(line_i < sizeof(line_buf)) {
-        length = 1;
-        res = serial_rec(ESP8266_DRV, &line_buf[line_i], &length);
-        if(res == HW_RES_OK && length == 1) {
-            /*Ignore leading '\r' and '\n'*/
-            if(line_i != 0 || (line_buf[0] != '\n' && line_buf[0] != '\r')) 
-            {
-//                char buf[2];
-//                buf[0] = line_buf[line_i];
-//                buf[1] = '\0';
-//                SMSG("%s", buf);
-                
-                line_i ++;
-
-                /*Check line ending*/
-                if(line_i >= 2) {
-                    if(line_buf[line_i - 1] == '\n' &&
-                       line_buf[line_i - 2] == '\r') 
-                    {
-                        line_buf[line_i] = '\0';   /*Close the sting*/
-                        line_i = 0;
-#if ESP8266_LOG_REC_LINES != 0
-                        SMSG("Line received: %s", line_buf);
-#endif
-                        return ESP8266_STATE_OK;
-                    }
-                }
-            }
-        } else {
+    uint16_t skip;
+    
+    while(1) {
+        length = sizeof(line_buf) - 1 - line_i;    /*Keep place for the closing '\0'*/
+        res = serial_rec_until(ESP8266_DRV, &line_buf[line_i], &length, "\r\n", 2);
+        line_i += length;
+        
+        if(res == HW_RES_EMPTY) {
+            /*Only a part of the line is received*/
+            if(length != 0) continue;
             return ESP8266_STATE_ERROR;
+        } else if(res != HW_RES_OK) {
+            SWARN("Overflow");
+            line_i = 0;
+            return ESP8266_STATE_BUSY;
         }
-    }
-    
-    if(line_i == sizeof(line_buf)) {
-        SWARN("Overflow");
+        
+        line_buf[line_i] = '\0';   /*Close the sting*/
+        
+        /*Ignore leading '\r' and '\n'*/
+        skip = 0;
+        while(line_buf[skip] == '\r' || line_buf[skip] == '\n') skip++;
+        if(skip == line_i) {
+            line_i = 0;     /*Empty line*/
+            continue;
+        }
+        if(skip != 0) memmove(line_buf, &line_buf[skip], line_i - skip + 1);
         line_i = 0;
+        
+#if ESP8266_LOG_REC_LINES != 0
+        SMSG("Line received: %s", line_buf);
+#endif
+        return ESP8266_STATE_OK;
     }
-    
-    return ESP8266_STATE_BUSY;
 }
 #endif /*USE_ESP8266 != 0*/
\ No newline at end of file
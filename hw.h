@@ -9,6 +9,7 @@
 /*********************
  *      INCLUDES
  *********************/
+#include <stdint.h>
 
 /*********************
  *      DEFINES
@@ -42,6 +43,13 @@ typedef enum
     HW_RES_TOUT,      /*Timeout*/
 }hw_res_t;
 
+/*Describes a part of a message stored in separate buffer (see e.g. serial_sendv)*/
+typedef struct
+{
+    const void * base;
+    uint32_t len;
+}hw_iovec_t;
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
@@ -51,5 +59,7 @@ void dev_init(void);
 /**********************
  *      MACROS
  **********************/
+/*Initializer of a hw_iovec_t from a string literal (without the closing '\0')*/
+#define HW_IOVEC_STR(s)     {(s), sizeof(s) - 1}
 
 #endif
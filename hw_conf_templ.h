@@ -108,12 +108,12 @@
 
 /*SERIAL0*/
 #define SERIAL0_PRIO       HW_INT_PRIO_OFF /*HW_INT_PRIO_OFF to disable module*/
-#define SERIAL0_BUF_SIZE   0				 /*0: disable module*/
+#define SERIAL0_BUF_SIZE   0				 /*0: disable module, else power of 2*/
 #define SERIAL0_MODE       (SERIAL_MODE_BASIC)
 
 /*SERIAL1*/
 #define SERIAL1_PRIO       HW_INT_PRIO_OFF /*HW_INT_PRIO_OFF to disable module*/
-#define SERIAL1_BUF_SIZE   0				 /*0: disable module*/
+#define SERIAL1_BUF_SIZE   0				 /*0: disable module, else power of 2*/
 #define SERIAL1_MODE       (SERIAL_MODE_BASIC)
 
 /*SERAL2*/
@@ -130,6 +130,8 @@
 #define SERIAL4_PRIO       HW_INT_PRIO_OFF /*HW_INT_PRIO_OFF to disable*/
 #define SERIAL4_BUF_SIZE   0
 #define SERIAL4_MODE       (SERIAL_MODE_BASIC)
+
+#define SERIAL_PEEK_SIZE   64   /*Bytes to look ahead in serial_peek/find/rec_until*/
 #endif /*USE_SERIAL*/
 
 /*-----------
@@ -11,7 +11,7 @@
 #include "derivative.h"
 #include <stddef.h>
 #include "hw/hw.h"
-#include "misc/mem/fifo.h"
+#include "hw/per/ringbuf.h"
 #include "../psp_serial.h"
 
 /***********************
@@ -24,6 +24,21 @@
  * Usage: #if SERIAL_MODULE_EN(2) ... #endif */
 #define SERIAL_MODULE_EN(x) (SERIAL ## x ##_BUF_SIZE != 0 && SERIAL ## x ##_PRIO != HW_INT_PRIO_OFF)
 
+#if SERIAL_MODULE_EN(0) && RINGBUF_SIZE_VALID(SERIAL0_BUF_SIZE) == 0
+#error "SERIAL0_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(1) && RINGBUF_SIZE_VALID(SERIAL1_BUF_SIZE) == 0
+#error "SERIAL1_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(2) && RINGBUF_SIZE_VALID(SERIAL2_BUF_SIZE) == 0
+#error "SERIAL2_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(3) && RINGBUF_SIZE_VALID(SERIAL3_BUF_SIZE) == 0
+#error "SERIAL3_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(4) && RINGBUF_SIZE_VALID(SERIAL4_BUF_SIZE) == 0
+#error "SERIAL4_BUF_SIZE must be power of 2"
+#endif
 
 /***********************
  *       TYPEDEFS
@@ -35,8 +50,13 @@ typedef struct
 	uint32_t buf_size;
 	uint32_t clk_en_mask;
     uint8_t mode;
-    fifo_t tx_fifo;
-    fifo_t rx_fifo;
+    ringbuf_t tx_rb;
+    ringbuf_t rx_rb;
+    uint32_t rx_th;                 /*Call 'rx_cb' when this many bytes are in 'rx_rb'*/
+    void (*rx_cb)(serial_t id);
+    uint32_t tx_lwm;                /*Call 'tx_cb' when 'tx_rb' drains to this level*/
+    volatile bool tx_lwm_armed;     /*A write was rejected since the last 'tx_cb' call*/
+    void (*tx_cb)(serial_t id);
 }m_dsc_t;
 
 /***********************
@@ -47,10 +67,10 @@ typedef struct
  *   STATIC VARIABLES
  ***********************/
 
-/*Create fifos for every SERIAL module*/
+/*Create ring buffers for every SERIAL module (the sizes must be power of 2)*/
 #if SERIAL_MODULE_EN(0)
-static uint8_t tbuf0[SERIAL1_BUF_SIZE];
-static uint8_t rbuf0[SERIAL1_BUF_SIZE];
+static uint8_t tbuf0[SERIAL0_BUF_SIZE];
+static uint8_t rbuf0[SERIAL0_BUF_SIZE];
 #endif
 #if SERIAL_MODULE_EN(1)
 static uint8_t tbuf1[SERIAL1_BUF_SIZE];
@@ -140,8 +160,8 @@ void psp_serial_init(void)
 			NVIC_ClearPendingIRQ(UART0_IRQn);  /* Clear any Pending IRQ for all PIT ch0 (#22) */
 			NVIC_EnableIRQ(UART0_IRQn);        /* Set Enable IRQ for PIT_CH0 */
 			NVIC_SetPriority(UART0_IRQn,0);    /* Set Priority for PIT_CH0 */
-			fifo_init(m_dsc[i].rx_fifo, rbuf0, sizeof(uint8_t), sizeof(rbuf0));
-			fifo_init(m_dsc[i].tx_fifo, tbuf0, sizeof(uint8_t), sizeof(tbuf0));
+			ringbuf_init(&m_dsc[i].rx_rb, rbuf0, sizeof(rbuf0));
+			ringbuf_init(&m_dsc[i].tx_rb, tbuf0, sizeof(tbuf0));
 #endif
 		} else if(i == 1) {
 #if SERIAL_MODULE_EN(1)
@@ -149,37 +169,36 @@ void psp_serial_init(void)
 			NVIC_ClearPendingIRQ(UART1_IRQn);  /* Clear any Pending IRQ for all PIT ch0 (#22) */
 			NVIC_EnableIRQ(UART1_IRQn);        /* Set Enable IRQ for PIT_CH0 */
 			NVIC_SetPriority(UART1_IRQn,0);    /* Set Priority for PIT_CH0 */
-			fifo_init(&m_dsc[i].rx_fifo, rbuf1, sizeof(uint8_t), sizeof(rbuf1));
-			fifo_init(&m_dsc[i].tx_fifo, tbuf1, sizeof(uint8_t), sizeof(tbuf1));
+			ringbuf_init(&m_dsc[i].rx_rb, rbuf1, sizeof(rbuf1));
+			ringbuf_init(&m_dsc[i].tx_rb, tbuf1, sizeof(tbuf1));
 #endif
 		} else if(i == 2) {
 #if SERIAL_MODULE_EN(2)
 			NVIC_ClearPendingIRQ(UART2_IRQn);  /* Clear any Pending IRQ for all PIT ch0 (#22) */
 			NVIC_EnableIRQ(UART2_IRQn);        /* Set Enable IRQ for PIT_CH0 */
 			NVIC_SetPriority(UART2_IRQn,0);    /* Set Priority for PIT_CH0 */
-			fifo_init(&m_dsc[i].rx_fifo, rbuf2, sizeof(uint8_t), sizeof(rbuf2));
-			fifo_init(&m_dsc[i].tx_fifo, tbuf2, sizeof(uint8_t), sizeof(tbuf2));
+			ringbuf_init(&m_dsc[i].rx_rb, rbuf2, sizeof(rbuf2));
+			ringbuf_init(&m_dsc[i].tx_rb, tbuf2, sizeof(tbuf2));
 #endif
 		} else if(i == 3) {
 #if SERIAL_MODULE_EN(3)
 			NVIC_ClearPendingIRQ(UART3_IRQn);  /* Clear any Pending IRQ for all PIT ch0 (#22) */
 			NVIC_EnableIRQ(UART3_IRQn);        /* Set Enable IRQ for PIT_CH0 */
 			NVIC_SetPriority(UART3_IRQn,0);    /* Set Priority for PIT_CH0 */
-			fifo_init(m_dsc[i].rx_fifo, rbuf3, sizeof(uint8_t), sizeof(rbuf3));
-			fifo_init(m_dsc[i].tx_fifo, tbuf3, sizeof(uint8_t), sizeof(tbuf3));
+			ringbuf_init(&m_dsc[i].rx_rb, rbuf3, sizeof(rbuf3));
+			ringbuf_init(&m_dsc[i].tx_rb, tbuf3, sizeof(tbuf3));
 #endif
 		} else if(i == 4) {
 #if SERIAL_MODULE_EN(4)
 			NVIC_ClearPendingIRQ(UART4_IRQn);  /* Clear any Pending IRQ for all PIT ch0 (#22) */
 			NVIC_EnableIRQ(UART4_IRQn);        /* Set Enable IRQ for PIT_CH0 */
 			NVIC_SetPriority(UART4_IRQn,0);    /* Set Priority for PIT_CH0 */
-			fifo_init(m_dsc[i].rx_fifo, rbuf4, sizeof(uint8_t), sizeof(rbuf4));
-			fifo_init(m_dsc[i].tx_fifo, tbuf4, sizeof(uint8_t), sizeof(tbuf4));
+			ringbuf_init(&m_dsc[i].rx_rb, rbuf4, sizeof(rbuf4));
+			ringbuf_init(&m_dsc[i].tx_rb, tbuf4, sizeof(tbuf4));
 #endif
 		}
 
 		psp_serial_rx_int_en(i, true);
-		psp_serial_tx_int_en(i, true);
 	}
 
 
@@ -194,33 +213,105 @@ void psp_serial_init(void)
  */
 hw_res_t psp_serial_wr(serial_t id, uint8_t tx)
 {
-    hw_res_t res = HW_RES_OK;
+    uint32_t length = 1;
+    
+    return psp_serial_wr_buf(id, &tx, &length);
+}
 
+/**
+ * Send a buffer via UART. As many bytes are buffered as fit into the tx buffer.
+ * The bytes are always sent from the tx interrupt (only it reads the tx buffer).
+ * @param id the id of the UART module (from serial_t enum)
+ * @param tx_buf pointer to the bytes to send
+ * @param length before call: number of bytes to send,
+ *               after call: number of buffered bytes
+ * @return HW_RES_OK or any error from hw_res_t (HW_RES_FULL if not every byte is buffered)
+ */
+hw_res_t psp_serial_wr_buf(serial_t id, const void * tx_buf, uint32_t * length)
+{
+    hw_res_t res = HW_RES_OK;
+    
     /*If a register is NULL then the module is disabled*/
     if(m_dsc[id].dsc != NULL) {
-        /*The fifo is used in the interrupt so disable interrupts*/
-        psp_serial_tx_int_en(id, 0);
-
-        if((m_dsc[id].dsc->S1 & UART_S1_TC_MASK) != 0) {
-        	m_dsc[id].dsc->D = tx;
-        } else {
-            bool fifo_ret;
-            fifo_ret = fifo_push(&m_dsc[id].tx_fifo, &tx);
-            /*Show the fifo become full so not all bytes are buffered*/
-            if(fifo_ret == false) {
-                res = HW_RES_FULL;
-            }
+        uint32_t n = ringbuf_push(&m_dsc[id].tx_rb, tx_buf, *length);
+        
+        /*Show the buffer become full so not all bytes are buffered*/
+        if(n != *length) {
+            m_dsc[id].tx_lwm_armed = true;
+            res = HW_RES_FULL;
         }
+        *length = n;
+        
+        /*Let the tx interrupt send the new bytes (or notify about the low watermark)*/
+        psp_serial_tx_int_en(id, true);
+    } else {
+        *length = 0;
+        res = HW_RES_DIS;
+    }
+    
+    return res;
+}
 
-        psp_serial_tx_int_en(id, 1);
+/**
+ * Send more buffers via UART as one message. Either every byte is buffered or none of them.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param iov array of buffers to send
+ * @param iov_num number of elements in 'iov'
+ * @return HW_RES_OK or any error from hw_res_t
+ *         (HW_RES_FULL: not enough free space now, HW_RES_INV_PARAM: never fits into the buffer)
+ */
+hw_res_t psp_serial_wr_vec(serial_t id, const hw_iovec_t * iov, uint32_t iov_num)
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].dsc == NULL) return HW_RES_DIS;
+
+    uint32_t total = 0;
+    uint32_t v;
+    for(v = 0; v < iov_num; v++) total += iov[v].len;
+    if(total > m_dsc[id].buf_size) return HW_RES_INV_PARAM;
+    if(total == 0) return HW_RES_OK;
+
+    hw_res_t res = HW_RES_OK;
 
+    /*Only this side pushes so the free space can only grow in the meantime*/
+    if(ringbuf_get_free(&m_dsc[id].tx_rb) < total) {
+        m_dsc[id].tx_lwm_armed = true;
+        res = HW_RES_FULL;
     } else {
-        res = HW_RES_DIS;
+        for(v = 0; v < iov_num; v++) {
+            ringbuf_push(&m_dsc[id].tx_rb, iov[v].base, iov[v].len);
+        }
     }
+    
+    psp_serial_tx_int_en(id, true);
 
     return res;
 }
 
+/**
+ * Set a callback function to call from the tx interrupt when a send was rejected
+ * because the tx buffer was full, and since then it has drained to a low watermark.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param level call 'cb' when at most this many bytes are waiting in the tx buffer
+ *              (< 0 or too large: half of the buffer)
+ * @param cb pointer to a callback function (NULL to disable)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_tx_lwm(serial_t id, int32_t level, void (*cb)(serial_t id))
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].dsc == NULL) return HW_RES_DIS;
+
+    if(level < 0 || (uint32_t)level >= m_dsc[id].buf_size) level = m_dsc[id].buf_size / 2;
+
+    /*Disable the callback while the level is changed*/
+    m_dsc[id].tx_cb = NULL;
+    m_dsc[id].tx_lwm = level;
+    m_dsc[id].tx_cb = cb;
+
+    return HW_RES_OK;
+}
+
 /**
  * Receive a byte from UART
  * @param id the id of the UART module (from serial_t enum)
@@ -229,20 +320,68 @@ hw_res_t psp_serial_wr(serial_t id, uint8_t tx)
  */
 hw_res_t psp_serial_rd(serial_t id, uint8_t * rx)
 {
-    hw_res_t res = HW_RES_OK;
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].dsc == NULL) return HW_RES_DIS;
+    
+    if(ringbuf_pop_byte(&m_dsc[id].rx_rb, rx) == false) return HW_RES_EMPTY;
+    
+    return HW_RES_OK;
+}
 
+/**
+ * Receive more bytes from UART
+ * @param id the id of the UART module (from serial_t enum)
+ * @param rx_buf the received bytes will be stored here
+ * @param length before call: max. number of bytes to read,
+ *               after call: number of read bytes
+ * @return HW_RES_OK or any error from hw_res_t (HW_RES_EMPTY if no byte was read)
+ */
+hw_res_t psp_serial_rd_buf(serial_t id, void * rx_buf, uint32_t * length)
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].dsc == NULL) {
+        *length = 0;
+        return HW_RES_DIS;
+    }
+
+    *length = ringbuf_pop(&m_dsc[id].rx_rb, rx_buf, *length);
+    if(*length == 0) return HW_RES_EMPTY;
+
+    return HW_RES_OK;
+}
+
+/**
+ * Set a callback function to call when the number of received bytes reaches a threshold.
+ * The callback is called from the rx interrupt.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param threshold call 'cb' when this many bytes are in the rx buffer
+ * @param cb pointer to a callback function (NULL to disable)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_rx_cb(serial_t id, uint32_t threshold, void (*cb)(serial_t id))
+{
     /*If a register is NULL then the module is disabled*/
     if(m_dsc[id].dsc == NULL) return HW_RES_DIS;
 
-    bool fifo_ret;
-    /*The fifo is used in the interrupt so disable interrupts*/
-    psp_serial_rx_int_en(id, 0);
-    fifo_ret = fifo_pop(&m_dsc[id].rx_fifo, rx);
-    psp_serial_rx_int_en(id, 1);
+    /*Disable the callback while the threshold is changed*/
+    m_dsc[id].rx_cb = NULL;
+    m_dsc[id].rx_th = threshold;
+    m_dsc[id].rx_cb = cb;
 
-    if(fifo_ret == false)  return HW_RES_EMPTY;
+    return HW_RES_OK;
+}
 
-    return res;
+/**
+ * Get the number of bytes in the rx buffer
+ * @param id the id of the UART module (from serial_t enum)
+ * @return number of received but not read bytes
+ */
+uint32_t psp_serial_get_rx_num(serial_t id)
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].dsc == NULL) return 0;
+
+    return ringbuf_get_used(&m_dsc[id].rx_rb);
 }
 
 /**
@@ -272,11 +411,11 @@ hw_res_t psp_serial_set_baud(serial_t id, uint32_t baud)
 hw_res_t psp_serial_clear_rx_buf(serial_t id)
 {
     hw_res_t res = HW_RES_OK;
-//    if(m_dsc[id].UxMODE != NULL) {
-//        fifo_clear(&m_dsc[id].rx_fifo);
-//    } else {
-//        res = HW_RES_DIS;
-//    }
+    if(m_dsc[id].dsc != NULL) {
+        ringbuf_clear(&m_dsc[id].rx_rb);
+    } else {
+        res = HW_RES_DIS;
+    }
     
     return res;
 }
@@ -305,20 +444,28 @@ static void irq_generic(serial_t id)
 		uint8_t recieve;
 		(void) m_dsc[id].dsc->S1;          /* Read UART_S1 register to clear RDRF (after reading data) */
 		recieve = m_dsc[id].dsc->D;         /* Read received data*/
-		//There is space in the buffer (not full)
-		if(fifo_get_free(&m_dsc[id].rx_fifo) != 0) {
-			fifo_push(&m_dsc[id].rx_fifo, &recieve);
+		//Lost if there is no space in the buffer
+		if(ringbuf_push_byte(&m_dsc[id].rx_rb, recieve) != false) {
+			if(m_dsc[id].rx_cb != NULL && ringbuf_get_used(&m_dsc[id].rx_rb) == m_dsc[id].rx_th) {
+				m_dsc[id].rx_cb(id);
+			}
 		}
 	}
 
 	else if(m_dsc[id].dsc->S1 & UART_S1_TDRE_MASK) {
 		uint8_t tx_char;
 		(void)m_dsc[id].dsc->S1;                    /* Read UART_S1 register to clear TDRE */
-		if(fifo_pop(&m_dsc[id].tx_fifo, &tx_char) != false) {
+		if(ringbuf_pop_byte(&m_dsc[id].tx_rb, &tx_char) != false) {
 			m_dsc[id].dsc->D = tx_char;                      /* Send data */
 		} else {
 			psp_serial_tx_int_en(id, false);
 		}
+		/*Notify the writer who found the buffer full if it has drained to the low watermark*/
+		if(m_dsc[id].tx_lwm_armed != false &&
+		   ringbuf_get_used(&m_dsc[id].tx_rb) <= m_dsc[id].tx_lwm) {
+			m_dsc[id].tx_lwm_armed = false;
+			if(m_dsc[id].tx_cb != NULL) m_dsc[id].tx_cb(id);
+		}
 	}
 }
 
@@ -0,0 +1,439 @@
+/**
+ * @file psp_serial.c
+ */
+
+/***********************
+ *       INCLUDES
+ ***********************/
+#include "hw_conf.h"
+#if USE_SERIAL != 0 && PSP_PC != 0
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "hw/hw.h"
+#include "hw/per/ringbuf.h"
+#include "../psp_serial.h"
+
+/***********************
+ *       DEFINES
+ ***********************/
+#define SERIAL_DEF_BAUD     9600
+#define SERIAL_LINE_PERIOD  1000    /*us*/
+
+/* Macro to check an SERIAL if enabled or not in the configurations (hw_conf)
+ * x: modul ID
+ * Usage: #if SERIAL_MODULE_EN(2) ... #endif */
+#define SERIAL_MODULE_EN(x) (SERIAL ## x ##_BUF_SIZE != 0 && SERIAL ## x ##_PRIO != HW_INT_PRIO_OFF)
+
+#if SERIAL_MODULE_EN(0) && RINGBUF_SIZE_VALID(SERIAL0_BUF_SIZE) == 0
+#error "SERIAL0_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(1) && RINGBUF_SIZE_VALID(SERIAL1_BUF_SIZE) == 0
+#error "SERIAL1_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(2) && RINGBUF_SIZE_VALID(SERIAL2_BUF_SIZE) == 0
+#error "SERIAL2_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(3) && RINGBUF_SIZE_VALID(SERIAL3_BUF_SIZE) == 0
+#error "SERIAL3_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(4) && RINGBUF_SIZE_VALID(SERIAL4_BUF_SIZE) == 0
+#error "SERIAL4_BUF_SIZE must be power of 2"
+#endif
+
+/***********************
+ *       TYPEDEFS
+ ***********************/
+typedef struct
+{
+	uint32_t buf_size;
+	uint8_t mode;
+	uint32_t baud;
+	int fd;					/*The sent bytes are written here*/
+	pthread_mutex_t rx_lock;	/*Serializes the threads calling 'psp_serial_pc_rx' (the single producer of 'rx_rb')*/
+	ringbuf_t tx_rb;
+	ringbuf_t rx_rb;
+	uint32_t rx_th;		/*Call 'rx_cb' when this many bytes are in 'rx_rb'*/
+	void (* volatile rx_cb)(serial_t id);
+	uint32_t tx_lwm;		/*Call 'tx_cb' when 'tx_rb' drains to this level*/
+	volatile bool tx_lwm_armed;	/*A write was rejected since the last 'tx_cb' call*/
+	void (* volatile tx_cb)(serial_t id);
+}m_dsc_t;
+
+/***********************
+ *   STATIC VARIABLES
+ ***********************/
+
+/*Create ring buffers for every SERIAL module (the sizes must be power of 2)*/
+#if SERIAL_MODULE_EN(0)
+static uint8_t tbuf0[SERIAL0_BUF_SIZE];
+static uint8_t rbuf0[SERIAL0_BUF_SIZE];
+#endif
+#if SERIAL_MODULE_EN(1)
+static uint8_t tbuf1[SERIAL1_BUF_SIZE];
+static uint8_t rbuf1[SERIAL1_BUF_SIZE];
+#endif
+#if SERIAL_MODULE_EN(2)
+static uint8_t tbuf2[SERIAL2_BUF_SIZE];
+static uint8_t rbuf2[SERIAL2_BUF_SIZE];
+#endif
+#if SERIAL_MODULE_EN(3)
+static uint8_t tbuf3[SERIAL3_BUF_SIZE];
+static uint8_t rbuf3[SERIAL3_BUF_SIZE];
+#endif
+#if SERIAL_MODULE_EN(4)
+static uint8_t tbuf4[SERIAL4_BUF_SIZE];
+static uint8_t rbuf4[SERIAL4_BUF_SIZE];
+#endif
+
+static m_dsc_t m_dsc[HW_SERIAL_NUM] =
+{
+	/*buf_size              mode */
+#if SERIAL_MODULE_EN(0)
+	{SERIAL0_BUF_SIZE,	SERIAL0_MODE},
+#else
+	{0,					0},
+#endif
+#if SERIAL_MODULE_EN(1)
+	{SERIAL1_BUF_SIZE,	SERIAL1_MODE},
+#else
+	{0,					0},
+#endif
+#if SERIAL_MODULE_EN(2)
+	{SERIAL2_BUF_SIZE,	SERIAL2_MODE},
+#else
+	{0,					0},
+#endif
+#if SERIAL_MODULE_EN(3)
+	{SERIAL3_BUF_SIZE,	SERIAL3_MODE},
+#else
+	{0,					0},
+#endif
+#if SERIAL_MODULE_EN(4)
+	{SERIAL4_BUF_SIZE,	SERIAL4_MODE},
+#else
+	{0,					0},
+#endif
+};
+
+/***********************
+ *   GLOBAL PROTOTYPES
+ ***********************/
+
+/***********************
+ *   STATIC PROTOTYPES
+ ***********************/
+static void * serial_line_han(void * param);
+
+/***********************
+ *   GLOBAL FUNCTIONS
+ ***********************/
+
+/**
+ * Initialize the simulated UART modules.
+ * Every enabled module gets a thread which empties the tx buffer with the speed of the baud rate.
+ * The application thread and this thread share the buffers without locking (single producer, single consumer).
+ */
+void psp_serial_init(void)
+{
+#if SERIAL_MODULE_EN(0)
+	ringbuf_init(&m_dsc[HW_SERIAL0].tx_rb, tbuf0, sizeof(tbuf0));
+	ringbuf_init(&m_dsc[HW_SERIAL0].rx_rb, rbuf0, sizeof(rbuf0));
+#endif
+#if SERIAL_MODULE_EN(1)
+	ringbuf_init(&m_dsc[HW_SERIAL1].tx_rb, tbuf1, sizeof(tbuf1));
+	ringbuf_init(&m_dsc[HW_SERIAL1].rx_rb, rbuf1, sizeof(rbuf1));
+#endif
+#if SERIAL_MODULE_EN(2)
+	ringbuf_init(&m_dsc[HW_SERIAL2].tx_rb, tbuf2, sizeof(tbuf2));
+	ringbuf_init(&m_dsc[HW_SERIAL2].rx_rb, rbuf2, sizeof(rbuf2));
+#endif
+#if SERIAL_MODULE_EN(3)
+	ringbuf_init(&m_dsc[HW_SERIAL3].tx_rb, tbuf3, sizeof(tbuf3));
+	ringbuf_init(&m_dsc[HW_SERIAL3].rx_rb, rbuf3, sizeof(rbuf3));
+#endif
+#if SERIAL_MODULE_EN(4)
+	ringbuf_init(&m_dsc[HW_SERIAL4].tx_rb, tbuf4, sizeof(tbuf4));
+	ringbuf_init(&m_dsc[HW_SERIAL4].rx_rb, rbuf4, sizeof(rbuf4));
+#endif
+
+	serial_t id;
+	for(id = HW_SERIAL0; id < HW_SERIAL_NUM; id++) {
+		if(m_dsc[id].buf_size == 0) continue;
+
+		m_dsc[id].baud = SERIAL_DEF_BAUD;
+		m_dsc[id].fd = STDOUT_FILENO;
+		pthread_mutex_init(&m_dsc[id].rx_lock, NULL);
+
+		pthread_t thread;
+		pthread_create(&thread, NULL, serial_line_han, &m_dsc[id]);
+	}
+}
+
+/**
+ * Send a byte via the simulated UART
+ * @param id the id of the UART module (from serial_t enum)
+ * @param tx byte to send
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_wr(serial_t id, uint8_t tx)
+{
+	uint32_t length = 1;
+
+	return psp_serial_wr_buf(id, &tx, &length);
+}
+
+/**
+ * Send a buffer via the simulated UART. As many bytes are buffered as fit into the tx buffer.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param tx_buf pointer to the bytes to send
+ * @param length before call: number of bytes to send,
+ *               after call: number of buffered bytes
+ * @return HW_RES_OK or any error from hw_res_t (HW_RES_FULL if not every byte is buffered)
+ */
+hw_res_t psp_serial_wr_buf(serial_t id, const void * tx_buf, uint32_t * length)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) {
+		*length = 0;
+		return HW_RES_DIS;
+	}
+
+	uint32_t n = ringbuf_push(&m_dsc[id].tx_rb, tx_buf, *length);
+	if(n != *length) m_dsc[id].tx_lwm_armed = true;
+
+	hw_res_t res = n == *length ? HW_RES_OK : HW_RES_FULL;
+	*length = n;
+
+	return res;
+}
+
+/**
+ * Send more buffers via the simulated UART as one message. Either every byte is buffered or none of them.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param iov array of buffers to send
+ * @param iov_num number of elements in 'iov'
+ * @return HW_RES_OK or any error from hw_res_t
+ *         (HW_RES_FULL: not enough free space now, HW_RES_INV_PARAM: never fits into the buffer)
+ */
+hw_res_t psp_serial_wr_vec(serial_t id, const hw_iovec_t * iov, uint32_t iov_num)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return HW_RES_DIS;
+
+	uint32_t total = 0;
+	uint32_t v;
+	for(v = 0; v < iov_num; v++) total += iov[v].len;
+	if(total > m_dsc[id].buf_size) return HW_RES_INV_PARAM;
+
+	hw_res_t res = HW_RES_OK;
+
+	/*Only this side pushes so the free space can only grow in the meantime*/
+	if(ringbuf_get_free(&m_dsc[id].tx_rb) < total) {
+		res = HW_RES_FULL;
+		m_dsc[id].tx_lwm_armed = true;
+	} else {
+		for(v = 0; v < iov_num; v++) {
+			ringbuf_push(&m_dsc[id].tx_rb, iov[v].base, iov[v].len);
+		}
+	}
+
+	return res;
+}
+
+/**
+ * Set a callback function to call when a send was rejected because the tx buffer was full,
+ * and since then it has drained to a low watermark.
+ * The callback is called from the thread which simulates the sending.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param level call 'cb' when at most this many bytes are waiting in the tx buffer
+ *              (< 0 or too large: half of the buffer)
+ * @param cb pointer to a callback function (NULL to disable)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_tx_lwm(serial_t id, int32_t level, void (*cb)(serial_t id))
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return HW_RES_DIS;
+
+	if(level < 0 || (uint32_t)level >= m_dsc[id].buf_size) level = m_dsc[id].buf_size / 2;
+
+	/*Disable the callback while the level is changed*/
+	m_dsc[id].tx_cb = NULL;
+	m_dsc[id].tx_lwm = level;
+	m_dsc[id].tx_cb = cb;
+
+	return HW_RES_OK;
+}
+
+/**
+ * Receive a byte from the simulated UART
+ * @param id the id of the UART module (from serial_t enum)
+ * @param rx pointer to variable to store the received byte
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_rd(serial_t id, uint8_t * rx)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return HW_RES_DIS;
+
+	if(ringbuf_pop_byte(&m_dsc[id].rx_rb, rx) == false) return HW_RES_EMPTY;
+
+	return HW_RES_OK;
+}
+
+/**
+ * Receive more bytes from the simulated UART
+ * @param id the id of the UART module (from serial_t enum)
+ * @param rx_buf the received bytes will be stored here
+ * @param length before call: max. number of bytes to read,
+ *               after call: number of read bytes
+ * @return HW_RES_OK or any error from hw_res_t (HW_RES_EMPTY if no byte was read)
+ */
+hw_res_t psp_serial_rd_buf(serial_t id, void * rx_buf, uint32_t * length)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) {
+		*length = 0;
+		return HW_RES_DIS;
+	}
+
+	*length = ringbuf_pop(&m_dsc[id].rx_rb, rx_buf, *length);
+	if(*length == 0) return HW_RES_EMPTY;
+
+	return HW_RES_OK;
+}
+
+/**
+ * Set a callback function to call when the number of received bytes reaches a threshold.
+ * The callback is called from the thread which simulates the receiving (see psp_serial_pc_rx).
+ * @param id the id of the UART module (from serial_t enum)
+ * @param threshold call 'cb' when this many bytes are in the rx buffer
+ * @param cb pointer to a callback function (NULL to disable)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_rx_cb(serial_t id, uint32_t threshold, void (*cb)(serial_t id))
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return HW_RES_DIS;
+
+	/*Disable the callback while the threshold is changed*/
+	m_dsc[id].rx_cb = NULL;
+	m_dsc[id].rx_th = threshold;
+	m_dsc[id].rx_cb = cb;
+
+	return HW_RES_OK;
+}
+
+/**
+ * Get the number of bytes in the rx buffer
+ * @param id the id of the UART module (from serial_t enum)
+ * @return number of received but not read bytes
+ */
+uint32_t psp_serial_get_rx_num(serial_t id)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return 0;
+
+	return ringbuf_get_used(&m_dsc[id].rx_rb);
+}
+
+/**
+ * Simulate receiving bytes on a UART. Handles the bytes like the rx interrupt of the MCUs.
+ * (bytes are lost if the rx buffer is full)
+ * @param id the id of the UART module (from serial_t enum)
+ * @param rx_buf the received bytes
+ * @param length number of bytes in 'rx_buf'
+ */
+void psp_serial_pc_rx(serial_t id, const void * rx_buf, uint32_t length)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return;
+
+	const uint8_t * buf8 = rx_buf;
+	void (*rx_cb)(serial_t id);
+	uint32_t i;
+
+	for(i = 0; i < length; i++) {
+		rx_cb = NULL;
+		pthread_mutex_lock(&m_dsc[id].rx_lock);
+		if(ringbuf_push_byte(&m_dsc[id].rx_rb, buf8[i]) != false) {
+			if(ringbuf_get_used(&m_dsc[id].rx_rb) == m_dsc[id].rx_th) rx_cb = m_dsc[id].rx_cb;
+		}
+		pthread_mutex_unlock(&m_dsc[id].rx_lock);
+
+		/*Call the callback without the lock to let it read the buffer*/
+		if(rx_cb != NULL) rx_cb(id);
+	}
+}
+
+/**
+ * Set the baud rate of the simulated UART. It sets the speed of emptying the tx buffer.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param baud the new baud rate
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_baud(serial_t id, uint32_t baud)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return HW_RES_DIS;
+	if(baud == 0) return HW_RES_INV_PARAM;
+
+	m_dsc[id].baud = baud;
+
+	return HW_RES_OK;
+}
+
+/**
+ * Clear all data from the rx buffer
+ * @param id the id of the UART module (from serial_t enum)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_clear_rx_buf(serial_t id)
+{
+	if(id >= HW_SERIAL_NUM || m_dsc[id].buf_size == 0) return HW_RES_DIS;
+
+	ringbuf_clear(&m_dsc[id].rx_rb);
+
+	return HW_RES_OK;
+}
+
+/***********************
+ *   STATIC FUNCTIONS
+ ***********************/
+
+/**
+ * Simulate the tx line of a UART: send as many bytes in every period as the baud rate allows
+ * @param param pointer to the m_dsc_t of the module
+ * @return NULL
+ */
+static void * serial_line_han(void * param)
+{
+	m_dsc_t * dsc = param;
+	serial_t id = dsc - m_dsc;
+	void (*tx_cb)(serial_t id);
+	uint8_t buf[256];
+	uint32_t max;
+	uint32_t n;
+
+	while(1) {
+		/*Number of bytes in a period (10 bits per byte)*/
+		max = (uint64_t) dsc->baud * SERIAL_LINE_PERIOD / 10 / 1000000;
+		if(max == 0) max = 1;
+		if(max > sizeof(buf)) max = sizeof(buf);
+
+		n = ringbuf_pop(&dsc->tx_rb, buf, max);
+
+		/*Notify the writer who found the buffer full if it has drained to the low watermark*/
+		if(dsc->tx_lwm_armed != false && ringbuf_get_used(&dsc->tx_rb) <= dsc->tx_lwm) {
+			dsc->tx_lwm_armed = false;
+			tx_cb = dsc->tx_cb;
+			if(tx_cb != NULL) tx_cb(id);
+		}
+
+		if(n != 0) {
+			if(write(dsc->fd, buf, n) < 0) {
+				/*Nothing to do, the bytes are lost like on a disconnected line*/
+			}
+		}
+
+		usleep(SERIAL_LINE_PERIOD);
+	}
+
+	return NULL;
+}
+
+#endif
@@ -12,8 +12,8 @@
 #include <sys/attribs.h>
 #include <stddef.h>
 #include "hw/hw.h"
-#include "misc/mem/fifo.h"
 #include "hw/per/tick.h"
+#include "hw/per/ringbuf.h"
 #include "../psp_serial.h"
 
 /***********************
@@ -70,6 +70,25 @@
 
 #define IPL_NAME(prio) IPL_CONC(prio)
 #define IPL_CONC(prio) IPL ## prio ## AUTO
+#if SERIAL_MODULE_EN(1) && RINGBUF_SIZE_VALID(SER1_BUF_SIZE) == 0
+#error "SER1_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(2) && RINGBUF_SIZE_VALID(SER2_BUF_SIZE) == 0
+#error "SER2_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(3) && RINGBUF_SIZE_VALID(SER3_BUF_SIZE) == 0
+#error "SER3_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(4) && RINGBUF_SIZE_VALID(SER4_BUF_SIZE) == 0
+#error "SER4_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(5) && RINGBUF_SIZE_VALID(SER5_BUF_SIZE) == 0
+#error "SER5_BUF_SIZE must be power of 2"
+#endif
+#if SERIAL_MODULE_EN(6) && RINGBUF_SIZE_VALID(SER6_BUF_SIZE) == 0
+#error "SER6_BUF_SIZE must be power of 2"
+#endif
+
 /***********************
  *       TYPEDEFS
  ***********************/
@@ -83,8 +102,13 @@ typedef struct
     volatile unsigned int * rx_reg;
     uint32_t buf_size;
     uint8_t mode;
-    fifo_t tx_fifo;
-    fifo_t rx_fifo;
+    ringbuf_t tx_rb;
+    ringbuf_t rx_rb;
+    uint32_t rx_th;                 /*Call 'rx_cb' when this many bytes are in 'rx_rb'*/
+    void (*rx_cb)(serial_t id);
+    uint32_t tx_lwm;                /*Call 'tx_cb' when 'tx_rb' drains to this level*/
+    volatile bool tx_lwm_armed;     /*A write was rejected since the last 'tx_cb' call*/
+    void (*tx_cb)(serial_t id);
 }m_dsc_t;
 
 /***********************
@@ -95,7 +119,7 @@ typedef struct
  *   STATIC VARIABLES
  ***********************/
 
-/*Create fifos for every SERIAL module*/
+/*Create ring buffers for every SERIAL module (the sizes must be power of 2)*/
 #if SERIAL_MODULE_EN(1)
 static uint8_t tbuf1[SER1_BUF_SIZE];
 static uint8_t rbuf1[SER1_BUF_SIZE];
@@ -171,8 +195,8 @@ static void psp_serial_init_irq(void);
 static void psp_serial_init_module(void);
 static void psp_serial_send_next(serial_t id);
 static void psp_serial_rec_next(serial_t modul_id);
-static void psp_serial_rx_int_en(serial_t id, uint8_t state);
 static void psp_serial_tx_int_en(serial_t id, uint8_t state);
+static void psp_serial_tx_start(serial_t id);
 
 /***********************
  *   GLOBAL FUNCTIONS
@@ -196,27 +220,38 @@ void psp_serial_init(void)
  */
 hw_res_t psp_serial_wr(serial_t id, uint8_t tx)
 {
+    uint32_t length = 1;
     
+    return psp_serial_wr_buf(id, &tx, &length);
+}
+
+/**
+ * Send a buffer via UART. As many bytes are buffered as fit into the tx buffer.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param tx_buf pointer to the bytes to send
+ * @param length before call: number of bytes to send,
+ *               after call: number of buffered bytes
+ * @return HW_RES_OK or any error from hw_res_t (HW_RES_FULL if not every byte is buffered)
+ */
+hw_res_t psp_serial_wr_buf(serial_t id, const void * tx_buf, uint32_t * length)
+{
     hw_res_t res = HW_RES_OK;
     
     /*If a register is NULL then the module is disabled*/
     if(m_dsc[id].UxMODE != NULL) {
-        bool fifo_ret;
-        /*The fifo is used in the interrupt so disable interrupts*/
-        psp_serial_tx_int_en(id, 0); 
-        fifo_ret = fifo_push(&m_dsc[id].tx_fifo, &tx); 
-        /* If data is added to the fifo start sending*/
-        if(fifo_ret != false && m_dsc[id].UxSTA->TRMT != 0) {
-            psp_serial_send_next(id);
-        }
-        
-        psp_serial_tx_int_en(id, 1);
+        uint32_t n = ringbuf_push(&m_dsc[id].tx_rb, tx_buf, *length);
         
-        /*Show the fifo become full so not all bytes are buffered*/
-        if(fifo_ret == false) {
+        /*Show the buffer become full so not all bytes are buffered*/
+        if(n != *length) {
+            m_dsc[id].tx_lwm_armed = true;
             res = HW_RES_FULL;
         }
+        *length = n;
+        
+        /*Let the tx interrupt send the new bytes (or notify about the low watermark)*/
+        psp_serial_tx_start(id);
     } else {
+        *length = 0;
         res = HW_RES_DIS;
     }
     
@@ -224,28 +259,135 @@ hw_res_t psp_serial_wr(serial_t id, uint8_t tx)
 }
 
 /**
- * Receive a byte from UART
+ * Send more buffers via UART as one message. Either every byte is buffered or none of them.
  * @param id the id of the UART module (from serial_t enum)
- * @param rx pointer to variable to store the received byte
+ * @param iov array of buffers to send
+ * @param iov_num number of elements in 'iov'
  * @return HW_RES_OK or any error from hw_res_t
+ *         (HW_RES_FULL: not enough free space now, HW_RES_INV_PARAM: never fits into the buffer)
  */
-hw_res_t psp_serial_rd(serial_t id, uint8_t * rx)
+hw_res_t psp_serial_wr_vec(serial_t id, const hw_iovec_t * iov, uint32_t iov_num)
 {
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].UxMODE == NULL) return HW_RES_DIS;
+
+    uint32_t total = 0;
+    uint32_t v;
+    for(v = 0; v < iov_num; v++) total += iov[v].len;
+    if(total > m_dsc[id].buf_size) return HW_RES_INV_PARAM;
+    if(total == 0) return HW_RES_OK;
+
     hw_res_t res = HW_RES_OK;
+
+    /*Only this side pushes so the free space can only grow in the meantime*/
+    if(ringbuf_get_free(&m_dsc[id].tx_rb) < total) {
+        m_dsc[id].tx_lwm_armed = true;
+        res = HW_RES_FULL;
+    } else {
+        for(v = 0; v < iov_num; v++) {
+            ringbuf_push(&m_dsc[id].tx_rb, iov[v].base, iov[v].len);
+        }
+    }
     
+    psp_serial_tx_start(id);
+
+    return res;
+}
+
+/**
+ * Set a callback function to call from the tx interrupt when a send was rejected
+ * because the tx buffer was full, and since then it has drained to a low watermark.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param level call 'cb' when at most this many bytes are waiting in the tx buffer
+ *              (< 0 or too large: half of the buffer)
+ * @param cb pointer to a callback function (NULL to disable)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_tx_lwm(serial_t id, int32_t level, void (*cb)(serial_t id))
+{
     /*If a register is NULL then the module is disabled*/
     if(m_dsc[id].UxMODE == NULL) return HW_RES_DIS;
-    
-    bool fifo_ret;
-    /*The fifo is used in the interrupt so disable interrupts*/
-    psp_serial_rx_int_en(id, 0); 
-    fifo_ret = fifo_pop(&m_dsc[id].rx_fifo, rx); 
-    psp_serial_rx_int_en(id, 1); 
 
-    if(fifo_ret == false)  return HW_RES_EMPTY;
+    if(level < 0 || (uint32_t)level >= m_dsc[id].buf_size) level = m_dsc[id].buf_size / 2;
+
+    /*Disable the callback while the level is changed*/
+    m_dsc[id].tx_cb = NULL;
+    m_dsc[id].tx_lwm = level;
+    m_dsc[id].tx_cb = cb;
+
+    return HW_RES_OK;
+}
+
+/**
+ * Receive a byte from UART
+ * @param id the id of the UART module (from serial_t enum)
+ * @param rx pointer to variable to store the received byte
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_rd(serial_t id, uint8_t * rx)
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].UxMODE == NULL) return HW_RES_DIS;
     
+    if(ringbuf_pop_byte(&m_dsc[id].rx_rb, rx) == false) return HW_RES_EMPTY;
     
-    return res;
+    return HW_RES_OK;
+}
+
+/**
+ * Receive more bytes from UART
+ * @param id the id of the UART module (from serial_t enum)
+ * @param rx_buf the received bytes will be stored here
+ * @param length before call: max. number of bytes to read,
+ *               after call: number of read bytes
+ * @return HW_RES_OK or any error from hw_res_t (HW_RES_EMPTY if no byte was read)
+ */
+hw_res_t psp_serial_rd_buf(serial_t id, void * rx_buf, uint32_t * length)
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].UxMODE == NULL) {
+        *length = 0;
+        return HW_RES_DIS;
+    }
+
+    *length = ringbuf_pop(&m_dsc[id].rx_rb, rx_buf, *length);
+    if(*length == 0) return HW_RES_EMPTY;
+
+    return HW_RES_OK;
+}
+
+/**
+ * Set a callback function to call when the number of received bytes reaches a threshold.
+ * The callback is called from the rx interrupt.
+ * @param id the id of the UART module (from serial_t enum)
+ * @param threshold call 'cb' when this many bytes are in the rx buffer
+ * @param cb pointer to a callback function (NULL to disable)
+ * @return HW_RES_OK or any error from hw_res_t
+ */
+hw_res_t psp_serial_set_rx_cb(serial_t id, uint32_t threshold, void (*cb)(serial_t id))
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].UxMODE == NULL) return HW_RES_DIS;
+
+    /*Disable the callback while the threshold is changed*/
+    m_dsc[id].rx_cb = NULL;
+    m_dsc[id].rx_th = threshold;
+    m_dsc[id].rx_cb = cb;
+
+    return HW_RES_OK;
+}
+
+/**
+ * Get the number of bytes in the rx buffer
+ * @param id the id of the UART module (from serial_t enum)
+ * @return number of received but not read bytes
+ */
+uint32_t psp_serial_get_rx_num(serial_t id)
+{
+    /*If a register is NULL then the module is disabled*/
+    if(m_dsc[id].UxMODE == NULL) return 0;
+
+    return ringbuf_get_used(&m_dsc[id].rx_rb);
 }
 
 /**
@@ -279,7 +421,7 @@ hw_res_t psp_serial_clear_rx_buf(serial_t id)
 {
     hw_res_t res = HW_RES_OK;
     if(m_dsc[id].UxMODE != NULL) {
-        fifo_clear(&m_dsc[id].rx_fifo);
+        ringbuf_clear(&m_dsc[id].rx_rb);
     } else {
         res = HW_RES_DIS;
     }
@@ -425,8 +567,8 @@ static void psp_serial_init_irq(void)
 #ifdef SERIAL1_RX_IF
 #if SERIAL_MODULE_EN(1)
     
-    fifo_init(&m_dsc[HW_SERIAL1].tx_fifo, tbuf1, sizeof(uint8_t), SER1_BUF_SIZE);
-    fifo_init(&m_dsc[HW_SERIAL1].rx_fifo, rbuf1, sizeof(uint8_t), SER1_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL1].tx_rb, tbuf1, SER1_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL1].rx_rb, rbuf1, SER1_BUF_SIZE);
     
     SERIAL1_RX_IF = 0;
     SERIAL1_TX_IF = 0;
@@ -439,8 +581,8 @@ static void psp_serial_init_irq(void)
 
 #ifdef SERIAL2_RX_IF
 #if SERIAL_MODULE_EN(2)
-    fifo_init(&m_dsc[HW_SERIAL2].tx_fifo, tbuf2, sizeof(uint8_t), SER2_BUF_SIZE);
-    fifo_init(&m_dsc[HW_SERIAL2].rx_fifo, rbuf2, sizeof(uint8_t), SER2_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL2].tx_rb, tbuf2, SER2_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL2].rx_rb, rbuf2, SER2_BUF_SIZE);
     
     SERIAL2_RX_IF = 0;
     SERIAL2_TX_IF = 0;
@@ -453,8 +595,8 @@ static void psp_serial_init_irq(void)
 
 #ifdef SERIAL3_RX_IF
 #if SERIAL_MODULE_EN(3)
-    fifo_init(&m_dsc[HW_SERIAL3].tx_fifo, tbuf3, sizeof(uint8_t), SER3_BUF_SIZE);
-    fifo_init(&m_dsc[HW_SERIAL3].rx_fifo, rbuf3, sizeof(uint8_t), SER3_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL3].tx_rb, tbuf3, SER3_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL3].rx_rb, rbuf3, SER3_BUF_SIZE);
     
     SERIAL3_RX_IF = 0;
     SERIAL3_TX_IF = 0;
@@ -469,8 +611,8 @@ static void psp_serial_init_irq(void)
 #ifdef SERIAL4_RX_IF
 #if SERIAL_MODULE_EN(4)
     
-    fifo_init(&m_dsc[HW_SERIAL4].tx_fifo, tbuf4, sizeof(uint8_t), SER4_BUF_SIZE);
-    fifo_init(&m_dsc[HW_SERIAL4].rx_fifo, rbuf4, sizeof(uint8_t), SER4_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL4].tx_rb, tbuf4, SER4_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL4].rx_rb, rbuf4, SER4_BUF_SIZE);
     
     SERIAL4_RX_IF = 0;
     SERIAL4_TX_IF = 0;
@@ -484,8 +626,8 @@ static void psp_serial_init_irq(void)
 #ifdef SERIAL5_RX_IF
 #if SERIAL_MODULE_EN(5)
     
-    fifo_init(&m_dsc[HW_SERIAL5].tx_fifo, tbuf5, sizeof(uint8_t), SER5_BUF_SIZE);
-    fifo_init(&m_dsc[HW_SERIAL5].rx_fifo, rbuf5, sizeof(uint8_t), SER5_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL5].tx_rb, tbuf5, SER5_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL5].rx_rb, rbuf5, SER5_BUF_SIZE);
     
     SERIAL5_RX_IF = 0;
     SERIAL5_TX_IF = 0;
@@ -500,8 +642,8 @@ static void psp_serial_init_irq(void)
 #ifdef SERIAL6_RX_IF
 #if SERIAL_MODULE_EN(6)
     
-    fifo_init(&m_dsc[HW_SERIAL6].tx_fifo, tbuf6, sizeof(uint8_t), SER6_BUF_SIZE);
-    fifo_init(&m_dsc[HW_SERIAL6].rx_fifo, rbuf6, sizeof(uint8_t), SER6_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL6].tx_rb, tbuf6, SER6_BUF_SIZE);
+    ringbuf_init(&m_dsc[HW_SERIAL6].rx_rb, rbuf6, SER6_BUF_SIZE);
     
     SERIAL6_RX_IF = 0;
     SERIAL6_TX_IF = 0;
@@ -537,23 +679,30 @@ static void psp_serial_init_module(void)
 }
 
 /**
- * Send the next byte from tx FIFO
+ * Send the next byte from the tx buffer. Called only from the tx interrupt.
  * @param id the id of the UART module (from serial_t enum)
  */
 static void psp_serial_send_next(serial_t id)
 {
+    m_dsc_t * dsc = &m_dsc[id];
     
     //pop the data from the buffer and send it
     uint8_t tx_byte;
-    if(fifo_pop(&m_dsc[id].tx_fifo, &tx_byte) != false) {
-        *m_dsc[id].tx_reg = tx_byte;
+    if(ringbuf_pop_byte(&dsc->tx_rb, &tx_byte) != false) {
+        *dsc->tx_reg = tx_byte;
     } else {
-        psp_serial_tx_int_en(id, 0); 
+        psp_serial_tx_int_en(id, 0);
+    }
+
+    /*Notify the writer who found the buffer full if it has drained to the low watermark*/
+    if(dsc->tx_lwm_armed != false && ringbuf_get_used(&dsc->tx_rb) <= dsc->tx_lwm) {
+        dsc->tx_lwm_armed = false;
+        if(dsc->tx_cb != NULL) dsc->tx_cb(id);
     }
 }
 
 /**
- * Read the UART module and push the read byte into the rx FIFO
+ * Read the UART module and push the read byte into the rx buffer. Called only from the rx interrupt.
  * @param id the id of the UART module (from serial_t enum)
  */
 static void psp_serial_rec_next(serial_t id)
@@ -564,59 +713,65 @@ static void psp_serial_rec_next(serial_t id)
     
     if(m_dsc[id].UxSTA->OERR != 0) m_dsc[id].UxSTA->OERR = 0;
     
-    //There is space in the buffer (not full)
-    if(fifo_get_free(&dsc->rx_fifo) != 0){
-        fifo_push(&dsc->rx_fifo, &rec_data);
+    //Lost if there is no space in the buffer
+    if(ringbuf_push_byte(&dsc->rx_rb, rec_data) != false) {
+        if(dsc->rx_cb != NULL && ringbuf_get_used(&dsc->rx_rb) == dsc->rx_th) {
+            dsc->rx_cb(id);
+        }
     }
 }
 
 /**
- * Enable or disable the rx interrupts
+ * Trigger the tx interrupt by software to send the buffered bytes.
+ * This way only the interrupt reads the tx buffer and it is never disabled.
  * @param id the id of the UART module (from serial_t enum)
- * @param state 0: disable interrupt, 1: enable interrupt
  */
-static void psp_serial_rx_int_en(serial_t id, uint8_t state)
+static void psp_serial_tx_start(serial_t id)
 {
-    //State can be only 0 or 1
-    if(state) state = 1;
-
     switch (id)
     {
 #if SERIAL_MODULE_EN(1)
         case HW_SERIAL1:
-            SERIAL1_RX_IE = state;
+            SERIAL1_TX_IE = 1;
+            SERIAL1_TX_IF = 1;
             break;
 #endif
 
 #if SERIAL_MODULE_EN(2)
         case HW_SERIAL2:
-            SERIAL2_RX_IE = state;
+            SERIAL2_TX_IE = 1;
+            SERIAL2_TX_IF = 1;
             break;
 #endif
 
 #if SERIAL_MODULE_EN(3)
         case HW_SERIAL3:
-            SERIAL3_RX_IE = state;
+            SERIAL3_TX_IE = 1;
+            SERIAL3_TX_IF = 1;
             break;
 #endif
 
 #if SERIAL_MODULE_EN(4)
         case HW_SERIAL4:
-            SERIAL4_RX_IE = state;
+            SERIAL4_TX_IE = 1;
+            SERIAL4_TX_IF = 1;
             break;
 #endif
-            
+
 #if SERIAL_MODULE_EN(5)
         case HW_SERIAL5:
-            SERIAL5_RX_IE = state;
+            SERIAL5_TX_IE = 1;
+            SERIAL5_TX_IF = 1;
             break;
 #endif
-            
+
 #if SERIAL_MODULE_EN(6)
         case HW_SERIAL6:
-            SERIAL6_RX_IE = state;
+            SERIAL6_TX_IE = 1;
+            SERIAL6_TX_IF = 1;
             break;
 #endif
+
         default:
             break;
     }
@@ -53,9 +53,19 @@ typedef enum
 
 void psp_serial_init(void);
 hw_res_t psp_serial_wr(serial_t id, uint8_t tx);
+hw_res_t psp_serial_wr_buf(serial_t id, const void * tx_buf, uint32_t * length);
+hw_res_t psp_serial_wr_vec(serial_t id, const hw_iovec_t * iov, uint32_t iov_num);
+hw_res_t psp_serial_set_tx_lwm(serial_t id, int32_t level, void (*cb)(serial_t id));
 hw_res_t psp_serial_rd(serial_t id, uint8_t * rx);
+hw_res_t psp_serial_rd_buf(serial_t id, void * rx_buf, uint32_t * length);
 hw_res_t psp_serial_set_baud(serial_t id, uint32_t baud);
 hw_res_t psp_serial_clear_rx_buf(serial_t id);
+hw_res_t psp_serial_set_rx_cb(serial_t id, uint32_t threshold, void (*cb)(serial_t id));
+uint32_t psp_serial_get_rx_num(serial_t id);
+
+#if PSP_PC != 0
+void psp_serial_pc_rx(serial_t id, const void * rx_buf, uint32_t length);
+#endif
 
 /**********************
  *      MACROS
@@ -0,0 +1,209 @@
+/**
+ * @file ringbuf.c
+ * Single producer, single consumer ring buffer.
+ * The read and write indexes are free running (they are masked only on access)
+ * so 'wp - rp' is always the number of used bytes and the whole buffer can be used.
+ * The indexes are 'unsigned int' to be read and written atomically on every MCU.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "hw_conf.h"
+#include <string.h>
+#include "ringbuf.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#if PSP_PC != 0
+/*The producer and consumer threads can run on different CPUs*/
+#define RINGBUF_BARRIER()   __sync_synchronize()
+#else
+/*Single core: only the compiler can reorder the accesses*/
+#define RINGBUF_BARRIER()   __asm__ volatile("" ::: "memory")
+#endif
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Initialize a ring buffer
+ * @param rb pointer to a ring buffer variable
+ * @param buf memory to store the bytes
+ * @param size size of 'buf' in bytes. Must be power of 2.
+ * @return true: initialized, false: invalid size
+ */
+bool ringbuf_init(ringbuf_t * rb, void * buf, unsigned int size)
+{
+    if(RINGBUF_SIZE_VALID(size) == false) return false;
+
+    rb->buf = buf;
+    rb->mask = size - 1;
+    rb->wp = 0;
+    rb->rp = 0;
+
+    return true;
+}
+
+/**
+ * Copy bytes into a ring buffer. (Producer side)
+ * @param rb pointer to a ring buffer
+ * @param data the bytes to copy
+ * @param length number of bytes in 'data'
+ * @return number of really copied bytes (less then 'length' if the buffer become full)
+ */
+unsigned int ringbuf_push(ringbuf_t * rb, const void * data, unsigned int length)
+{
+    unsigned int wp = rb->wp;
+    unsigned int free = rb->mask + 1 - (wp - rb->rp);
+    if(length > free) length = free;
+    if(length == 0) return 0;
+
+    /*Copy in two parts if the data wraps around the end of the buffer*/
+    unsigned int ofs = wp & rb->mask;
+    unsigned int first = rb->mask + 1 - ofs;
+    if(first > length) first = length;
+    memcpy(&rb->buf[ofs], data, first);
+    memcpy(rb->buf, (const uint8_t *)data + first, length - first);
+
+    RINGBUF_BARRIER();      /*The data has to be written before the consumer sees the new index*/
+    rb->wp = wp + length;
+
+    return length;
+}
+
+/**
+ * Put one byte into a ring buffer. (Producer side)
+ * @param rb pointer to a ring buffer
+ * @param data the byte to put
+ * @return true: success, false: the buffer is full
+ */
+bool ringbuf_push_byte(ringbuf_t * rb, uint8_t data)
+{
+    unsigned int wp = rb->wp;
+    if(wp - rb->rp > rb->mask) return false;
+
+    rb->buf[wp & rb->mask] = data;
+
+    RINGBUF_BARRIER();
+    rb->wp = wp + 1;
+
+    return true;
+}
+
+/**
+ * Get the free space in a ring buffer. It can only grow until the producer pushes.
+ * @param rb pointer to a ring buffer
+ * @return number of free bytes
+ */
+unsigned int ringbuf_get_free(const ringbuf_t * rb)
+{
+    return rb->mask + 1 - (rb->wp - rb->rp);
+}
+
+/**
+ * Copy and remove bytes from a ring buffer. (Consumer side)
+ * @param rb pointer to a ring buffer
+ * @param data store the bytes here
+ * @param length max. number of bytes to read
+ * @return number of really read bytes
+ */
+unsigned int ringbuf_pop(ringbuf_t * rb, void * data, unsigned int length)
+{
+    unsigned int rp = rb->rp;
+
+    length = ringbuf_peek(rb, data, length);
+    if(length == 0) return 0;
+
+    RINGBUF_BARRIER();      /*The data has to be read before the producer can overwrite it*/
+    rb->rp = rp + length;
+
+    return length;
+}
+
+/**
+ * Get one byte from a ring buffer. (Consumer side)
+ * @param rb pointer to a ring buffer
+ * @param data store the byte here
+ * @return true: success, false: the buffer is empty
+ */
+bool ringbuf_pop_byte(ringbuf_t * rb, uint8_t * data)
+{
+    unsigned int rp = rb->rp;
+    if(rp == rb->wp) return false;
+
+    RINGBUF_BARRIER();
+    *data = rb->buf[rp & rb->mask];
+
+    RINGBUF_BARRIER();
+    rb->rp = rp + 1;
+
+    return true;
+}
+
+/**
+ * Copy bytes from a ring buffer without removing them. (Consumer side)
+ * @param rb pointer to a ring buffer
+ * @param data store the bytes here
+ * @param length max. number of bytes to read
+ * @return number of really read bytes
+ */
+unsigned int ringbuf_peek(const ringbuf_t * rb, void * data, unsigned int length)
+{
+    unsigned int rp = rb->rp;
+    unsigned int used = rb->wp - rp;
+    if(length > used) length = used;
+    if(length == 0) return 0;
+
+    RINGBUF_BARRIER();      /*Read the data only after the index*/
+
+    /*Copy in two parts if the data wraps around the end of the buffer*/
+    unsigned int ofs = rp & rb->mask;
+    unsigned int first = rb->mask + 1 - ofs;
+    if(first > length) first = length;
+    memcpy(data, &rb->buf[ofs], first);
+    memcpy((uint8_t *)data + first, rb->buf, length - first);
+
+    return length;
+}
+
+/**
+ * Get the number of bytes in a ring buffer. It can only grow until the consumer pops.
+ * @param rb pointer to a ring buffer
+ * @return number of used bytes
+ */
+unsigned int ringbuf_get_used(const ringbuf_t * rb)
+{
+    return rb->wp - rb->rp;
+}
+
+/**
+ * Remove all bytes from a ring buffer. (Consumer side)
+ * @param rb pointer to a ring buffer
+ */
+void ringbuf_clear(ringbuf_t * rb)
+{
+    rb->rp = rb->wp;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
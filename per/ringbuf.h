@@ -0,0 +1,56 @@
+/**
+ * @file ringbuf.h
+ * Single producer, single consumer ring buffer.
+ * One side can be an interrupt, the other side a normal (or on PC another) thread.
+ * Neither side needs to disable interrupts.
+ */
+
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct
+{
+    uint8_t * buf;
+    unsigned int mask;          /*Size of 'buf' - 1*/
+    volatile unsigned int wp;   /*Free running write index (written only by the producer)*/
+    volatile unsigned int rp;   /*Free running read index (written only by the consumer)*/
+}ringbuf_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+bool ringbuf_init(ringbuf_t * rb, void * buf, unsigned int size);
+
+/*Producer side*/
+unsigned int ringbuf_push(ringbuf_t * rb, const void * data, unsigned int length);
+bool ringbuf_push_byte(ringbuf_t * rb, uint8_t data);
+unsigned int ringbuf_get_free(const ringbuf_t * rb);
+
+/*Consumer side*/
+unsigned int ringbuf_pop(ringbuf_t * rb, void * data, unsigned int length);
+bool ringbuf_pop_byte(ringbuf_t * rb, uint8_t * data);
+unsigned int ringbuf_peek(const ringbuf_t * rb, void * data, unsigned int length);
+unsigned int ringbuf_get_used(const ringbuf_t * rb);
+void ringbuf_clear(ringbuf_t * rb);
+
+/**********************
+ *      MACROS
+ **********************/
+
+/*True if 'size' can be used as ring buffer size (power of 2)*/
+#define RINGBUF_SIZE_VALID(size)    ((size) != 0 && ((size) & ((size) - 1)) == 0)
+
+#endif
@@ -9,6 +9,7 @@
 #if USE_SERIAL != 0
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <string.h>
 #include "serial.h"
 #include "hw/per/tick.h"
@@ -17,10 +18,25 @@
 /***********************
  *       DEFINES
  ***********************/
+#ifndef SERIAL_PEEK_SIZE
+#define SERIAL_PEEK_SIZE    64      /*Bytes to look ahead with serial_peek/find/rec_until*/
+#endif
 
 /***********************
  *       TYPEDEFS
  ***********************/
+typedef struct
+{
+    serial_rx_cb_t rx_cb;
+    uint32_t idle_timeout;
+    uint32_t idle_cnt;
+    uint32_t rx_num_prev;
+    void (*tx_wait_hook)(serial_t id);
+    volatile bool tx_space;             /*Set by the PSP when the tx buffer drained to the low watermark*/
+    bool tx_lwm_en;
+    uint8_t peek_buf[SERIAL_PEEK_SIZE];  /*Received bytes already read from the PSP but not by the user*/
+    uint32_t peek_num;
+}m_dsc_t;
 
 /***********************
  *   GLOBAL VARIABLES
@@ -29,6 +45,10 @@
 /***********************
  *   STATIC VARIABLES
  ***********************/
+static m_dsc_t m_dsc[HW_SERIAL_NUM];
+#if USE_TICK != 0 && TICK_FUNC_NUM != 0
+static bool idle_task_added = false;
+#endif
 
 /***********************
  *   GLOBAL PROTOTYPES
@@ -37,6 +57,15 @@
 /***********************
  *   STATIC PROTOTYPES
  ***********************/
+static void serial_rx_th_cb(serial_t id);
+static void serial_tx_lwm_cb(serial_t id);
+static void serial_tx_wait(serial_t id);
+static void serial_peek_fill(serial_t id);
+static uint32_t serial_peek_take(serial_t id, void * buf, uint32_t length);
+static int32_t serial_peek_search(serial_t id, const void * pattern, uint32_t pattern_len);
+#if USE_TICK != 0 && TICK_FUNC_NUM != 0
+static void serial_rx_idle_task(void);
+#endif
 
 /***********************
  *   GLOBAL FUNCTIONS
@@ -51,6 +80,11 @@ void serial_init(void)
 {
     psp_serial_init();
     
+    /*Wait for the tx low watermark instead of fix delays in the blocking sends*/
+    serial_t id;
+    for(id = HW_SERIAL0; id < HW_SERIAL_NUM; id++) {
+        serial_set_tx_lwm(id, SERIAL_TX_LWM_DEF, NULL);
+    }
 }
 
 /**
@@ -68,21 +102,14 @@ hw_res_t serial_send(serial_t id, const void * tx_buf, int32_t * length)
 {
     hw_res_t res = HW_RES_OK;
     
-    const uint8_t * buf8 = tx_buf;
     if(*length == SERIAL_SEND_STRING) *length = strlen(tx_buf);
     
-    uint32_t i;
-    for(i = 0; i < *length; i++) {
-        res = psp_serial_wr(id, buf8[i]);
-
-        /*Return if any error occurred*/
-        if(res != HW_RES_OK) {
-            break;
-        }
-    }
+    /*Buffer as much as possible in one step*/
+    uint32_t sent = *length;
+    res = psp_serial_wr_buf(id, tx_buf, &sent);
     
     /*Set the sent number of bytes*/
-    *length = i;
+    *length = sent;
     
     //Return with the result
     return res;
@@ -101,19 +128,20 @@ hw_res_t serial_send_force(serial_t id, const void * tx_buf, int32_t length)
     hw_res_t res = HW_RES_OK;
     
     const uint8_t * buf8 = tx_buf;
-    uint32_t i;
+    uint32_t sent;
     if(length == SERIAL_SEND_STRING) length = strlen(tx_buf);
 
-    for(i = 0; i < length; i++) {
-        do {
-            res = psp_serial_wr(id, buf8[i]);
-            if(res == HW_RES_FULL) {
-                tick_wait_ms(1);
-            }
-        } while(res == HW_RES_FULL);
+    while(length > 0) {
+        /*Buffer as many bytes as the FIFO can hold*/
+        sent = length;
+        m_dsc[id].tx_space = false;
+        res = psp_serial_wr_buf(id, buf8, &sent);
+        buf8 += sent;
+        length -= sent;
         
-        
-        if(res != HW_RES_OK) {
+        if(res == HW_RES_FULL) {
+            serial_tx_wait(id);
+        } else if(res != HW_RES_OK) {
             break;
         }
     }
@@ -122,6 +150,39 @@ hw_res_t serial_send_force(serial_t id, const void * tx_buf, int32_t length)
     return res;
 }
 
+/**
+ * Send a message from more buffers on SERIAL. (Blocking send)
+ * The parts are buffered together so other messages can not interleave with them.
+ * If the message is longer then the tx buffer it is sent part by part.
+ * @param id the id of an SERIAL modul
+ * @param iov array of buffers to send (in this order)
+ * @param iov_num number of elements in 'iov'
+ * @return HW_RES_OK or error
+ */
+hw_res_t serial_sendv(serial_t id, const hw_iovec_t * iov, uint32_t iov_num)
+{
+    hw_res_t res;
+    
+    /*Wait until the whole message fits into the buffer*/
+    do {
+        m_dsc[id].tx_space = false;
+        res = psp_serial_wr_vec(id, iov, iov_num);
+        if(res == HW_RES_FULL) serial_tx_wait(id);
+    } while(res == HW_RES_FULL);
+    
+    /*Too long to buffer at once so send the parts one by one*/
+    if(res == HW_RES_INV_PARAM) {
+        uint32_t v;
+        for(v = 0; v < iov_num; v++) {
+            res = serial_send_force(id, iov[v].base, iov[v].len);
+            if(res != HW_RES_OK) break;
+        }
+    }
+    
+    //Return with the result
+    return res;
+}
+
 /*
  * Receive data from SERIAL
  * @param id the id of an SERIAL modul
@@ -136,15 +197,16 @@ hw_res_t serial_rec(serial_t id, void * rx_buf, int32_t * length)
     
     uint8_t * buf8 = rx_buf;
     uint32_t i;
-    hw_res_t psp_res;
-
-    for(i = 0; i < *length; i++) {
-        psp_res = psp_serial_rd(id, &buf8[i]);
-
-        /*Return if any error occurred*/
-        if(psp_res != HW_RES_OK) {
-            break;
-        }
+    uint32_t n;
+    
+    /*Give the already peeked bytes first*/
+    i = serial_peek_take(id, buf8, *length);
+    
+    /*Read the rest in one step*/
+    n = *length - i;
+    if(n != 0) {
+        psp_serial_rd_buf(id, &buf8[i], &n);
+        i += n;
     }
     
     /*Set the received number of bytes*/
@@ -165,23 +227,117 @@ hw_res_t serial_rec(serial_t id, void * rx_buf, int32_t * length)
  */
 hw_res_t serial_rec_force(serial_t id, void * rx_buf, int32_t length)
 {
-     hw_res_t res = HW_RES_OK;
+    hw_res_t res = HW_RES_OK;
    
     uint8_t * buf8 = rx_buf;
-    uint32_t i = 0;
+    uint32_t i;
+    uint32_t n;
 
+    /*Give the already peeked bytes first*/
+    i = serial_peek_take(id, buf8, length);
+    
     while(i < length) {
-        res = psp_serial_rd(id, &buf8[i]);
+        n = length - i;
+        res = psp_serial_rd_buf(id, &buf8[i], &n);
+        i += n;
 
         /*Check the return value*/
-        if (res == HW_RES_OK) i++;
-        else if (res == HW_RES_EMPTY)  tick_wait_ms(1);
-        else  break;
+        if (res == HW_RES_EMPTY)  tick_wait_ms(1);
+        else if(res != HW_RES_OK) break;
     }
+    
+    if(res == HW_RES_EMPTY) res = HW_RES_OK;
+    
     //Return with the result
     return res;
 }
 
+/**
+ * Receive data from SERIAL until a delimiter (e.g. "\r\n") is received.
+ * It can be called repeatedly to receive long messages in more parts.
+ * @param id the id of an SERIAL modul
+ * @param rx_buf the received bytes will be stored here
+ * @param length before call: size of 'rx_buf'
+ *               after call: number of bytes stored in 'rx_buf'
+ * @param delim the delimiter
+ * @param delim_len length of the delimiter (max. SERIAL_PEEK_SIZE)
+ * @return HW_RES_OK: the delimiter is received (and it is stored at the end of 'rx_buf'),
+ *         HW_RES_EMPTY: no delimiter yet. The bytes which are surely not part of
+ *                       the delimiter are stored anyway (see 'length')
+ *         HW_RES_FULL: the delimiter was not found in 'length' bytes
+ */
+hw_res_t serial_rec_until(serial_t id, void * rx_buf, int32_t * length, const void * delim, uint32_t delim_len)
+{
+    if(id >= HW_SERIAL_NUM) return HW_RES_NOT_EX;
+    if(delim_len == 0 || delim_len > SERIAL_PEEK_SIZE) {
+        *length = 0;
+        return HW_RES_INV_PARAM;
+    }
+    
+    hw_res_t res;
+    uint32_t n;
+    int32_t pos;
+    
+    serial_peek_fill(id);
+    pos = serial_peek_search(id, delim, delim_len);
+    if(pos >= 0) {
+        /*Delimiter found: give the bytes until its end*/
+        n = pos + delim_len;
+        res = HW_RES_OK;
+    } else {
+        /*No delimiter: give the bytes which can not be the beginning of the delimiter*/
+        n = m_dsc[id].peek_num >= delim_len - 1 ? m_dsc[id].peek_num - (delim_len - 1) : 0;
+        res = HW_RES_EMPTY;
+    }
+    
+    /*The delimiter can not be received into 'rx_buf'*/
+    if(n > *length || (res == HW_RES_EMPTY && n == *length)) {
+        n = *length;
+        res = HW_RES_FULL;
+    }
+    
+    *length = serial_peek_take(id, rx_buf, n);
+    
+    return res;
+}
+
+/**
+ * Read received bytes without removing them from the rx buffer
+ * @param id the id of an SERIAL modul
+ * @param rx_buf the received bytes will be copied here
+ * @param length before call: how many bytes should be read (max. SERIAL_PEEK_SIZE),
+ *               after call: the number of real read bytes
+ * @return HW_RES_OK or error
+ */
+hw_res_t serial_peek(serial_t id, void * rx_buf, int32_t * length)
+{
+    if(id >= HW_SERIAL_NUM) return HW_RES_NOT_EX;
+    
+    serial_peek_fill(id);
+    
+    if(*length > m_dsc[id].peek_num) *length = m_dsc[id].peek_num;
+    memcpy(rx_buf, m_dsc[id].peek_buf, *length);
+    
+    return HW_RES_OK;
+}
+
+/**
+ * Search a byte sequence among the received bytes without removing anything from the rx buffer
+ * @param id the id of an SERIAL modul
+ * @param pattern the byte sequence to find
+ * @param pattern_len length of 'pattern'
+ * @return the index of the first byte of 'pattern' in the rx buffer or -1 if not found
+ *         (only the first SERIAL_PEEK_SIZE bytes are searched)
+ */
+int32_t serial_find(serial_t id, const void * pattern, uint32_t pattern_len)
+{
+    if(id >= HW_SERIAL_NUM) return -1;
+    
+    serial_peek_fill(id);
+    
+    return serial_peek_search(id, pattern, pattern_len);
+}
+
 hw_res_t serial_set_baud(serial_t id, uint32_t baud)
 {
     hw_res_t res = HW_RES_OK;
@@ -195,11 +351,75 @@ hw_res_t serial_clear_rx_buf(serial_t id)
 {
     hw_res_t res = HW_RES_OK;
     
+    if(id < HW_SERIAL_NUM) m_dsc[id].peek_num = 0;
     res = psp_serial_clear_rx_buf(id);
     
     return res;
 }
 
+/**
+ * Set a callback function to get notified about the received data instead of polling.
+ * The callback is called from interrupt so keep it short.
+ * @param id the id of an SERIAL modul
+ * @param threshold call 'cb' with SERIAL_RX_EVT_THRESHOLD when this many bytes are buffered (0: not used)
+ * @param idle_timeout call 'cb' with SERIAL_RX_EVT_IDLE if no new byte is received
+ *                     for this many milliseconds but the rx buffer is not empty (0: not used)
+ * @param cb pointer to a callback function (NULL to disable the notifications)
+ * @return HW_RES_OK or error
+ */
+hw_res_t serial_set_rx_cb(serial_t id, uint32_t threshold, uint32_t idle_timeout, serial_rx_cb_t cb)
+{
+    if(id >= HW_SERIAL_NUM) return HW_RES_NOT_EX;
+    
+#if USE_TICK != 0 && TICK_FUNC_NUM != 0
+    /*The idle line is checked in every ms in a tick function*/
+    if(idle_timeout != 0 && idle_task_added == false) {
+        if(tick_add_func(serial_rx_idle_task) == false) return HW_RES_FULL;
+        idle_task_added = true;
+    }
+#else
+    /*Idle detection requires tick functions*/
+    if(idle_timeout != 0) return HW_RES_DIS;
+#endif
+    
+    /*Disable the callback while the parameters are changed*/
+    m_dsc[id].rx_cb = NULL;
+    m_dsc[id].idle_timeout = idle_timeout;
+    m_dsc[id].idle_cnt = 0;
+    m_dsc[id].rx_num_prev = psp_serial_get_rx_num(id);
+    m_dsc[id].rx_cb = cb;
+    
+    hw_res_t res;
+    if(cb != NULL && threshold != 0) res = psp_serial_set_rx_cb(id, threshold, serial_rx_th_cb);
+    else res = psp_serial_set_rx_cb(id, 0, NULL);
+    
+    if(res != HW_RES_OK) m_dsc[id].rx_cb = NULL;
+    
+    return res;
+}
+
+/**
+ * Set when the blocking sends can continue after they found the tx buffer full.
+ * (By default it is half of the tx buffer without wait hook)
+ * @param id the id of an SERIAL modul
+ * @param level continue when at most this many bytes are waiting in the tx buffer
+ *              (SERIAL_TX_LWM_DEF can be used)
+ * @param wait_hook called repeatedly while waiting for the low watermark, e.g. to yield to
+ *                  other tasks or enter idle mode (NULL: busy wait)
+ * @return HW_RES_OK or error
+ */
+hw_res_t serial_set_tx_lwm(serial_t id, int32_t level, void (*wait_hook)(serial_t id))
+{
+    if(id >= HW_SERIAL_NUM) return HW_RES_NOT_EX;
+    
+    hw_res_t res = psp_serial_set_tx_lwm(id, level, serial_tx_lwm_cb);
+    
+    m_dsc[id].tx_wait_hook = wait_hook;
+    m_dsc[id].tx_lwm_en = res == HW_RES_OK ? true : false;
+    
+    return res;
+}
+
 /**
  * Estimate the required time of data sending
  * @param byte_num the number of bytes to send
@@ -215,4 +435,123 @@ uint32_t serial_get_send_time(uint32_t byte_num, uint32_t baud)
  *   STATIC FUNCTIONS
  ***********************/
 
+/**
+ * Called by the PSP when the rx threshold is reached
+ * @param id the id of an SERIAL modul
+ */
+static void serial_rx_th_cb(serial_t id)
+{
+    serial_rx_cb_t cb = m_dsc[id].rx_cb;
+    if(cb != NULL) cb(id, SERIAL_RX_EVT_THRESHOLD);
+}
+
+/**
+ * Called by the PSP when the tx buffer drained to the low watermark
+ * @param id the id of an SERIAL modul
+ */
+static void serial_tx_lwm_cb(serial_t id)
+{
+    m_dsc[id].tx_space = true;
+}
+
+/**
+ * Wait until there is space in the tx buffer again
+ * @param id the id of an SERIAL modul
+ */
+static void serial_tx_wait(serial_t id)
+{
+    /*Without low watermark just wait a little*/
+    if(m_dsc[id].tx_lwm_en == false) {
+        tick_wait_ms(1);
+        return;
+    }
+    
+    while(m_dsc[id].tx_space == false) {
+        if(m_dsc[id].tx_wait_hook != NULL) m_dsc[id].tx_wait_hook(id);
+    }
+}
+
+/**
+ * Read as many bytes from the PSP as fit into the peek buffer
+ * @param id the id of an SERIAL modul
+ */
+static void serial_peek_fill(serial_t id)
+{
+    uint32_t n = SERIAL_PEEK_SIZE - m_dsc[id].peek_num;
+    if(n == 0) return;
+    
+    psp_serial_rd_buf(id, &m_dsc[id].peek_buf[m_dsc[id].peek_num], &n);
+    m_dsc[id].peek_num += n;
+}
+
+/**
+ * Remove bytes from the beginning of the peek buffer
+ * @param id the id of an SERIAL modul
+ * @param buf copy the removed bytes here
+ * @param length number of bytes to remove
+ * @return the number of really removed bytes
+ */
+static uint32_t serial_peek_take(serial_t id, void * buf, uint32_t length)
+{
+    if(id >= HW_SERIAL_NUM) return 0;
+    
+    m_dsc_t * dsc = &m_dsc[id];
+    if(length > dsc->peek_num) length = dsc->peek_num;
+    if(length == 0) return 0;
+    
+    memcpy(buf, dsc->peek_buf, length);
+    dsc->peek_num -= length;
+    memmove(dsc->peek_buf, &dsc->peek_buf[length], dsc->peek_num);
+    
+    return length;
+}
+
+/**
+ * Search a byte sequence in the peek buffer
+ * @param id the id of an SERIAL modul
+ * @param pattern the byte sequence to find
+ * @param pattern_len length of 'pattern'
+ * @return index of 'pattern' in the peek buffer or -1 if not found
+ */
+static int32_t serial_peek_search(serial_t id, const void * pattern, uint32_t pattern_len)
+{
+    const uint8_t * pat8 = pattern;
+    const uint8_t * buf8 = m_dsc[id].peek_buf;
+    uint32_t num = m_dsc[id].peek_num;
+    uint32_t i;
+    
+    if(pattern_len == 0 || pattern_len > num) return -1;
+    
+    for(i = 0; i <= num - pattern_len; i++) {
+        if(buf8[i] == pat8[0] && memcmp(&buf8[i], pat8, pattern_len) == 0) return i;
+    }
+    
+    return -1;
+}
+
+#if USE_TICK != 0 && TICK_FUNC_NUM != 0
+/**
+ * Called in every ms to detect when the rx line goes idle
+ */
+static void serial_rx_idle_task(void)
+{
+    serial_t id;
+    uint32_t rx_num;
+    for(id = HW_SERIAL0; id < HW_SERIAL_NUM; id++) {
+        serial_rx_cb_t cb = m_dsc[id].rx_cb;
+        if(cb == NULL || m_dsc[id].idle_timeout == 0) continue;
+        
+        rx_num = psp_serial_get_rx_num(id);
+        if(rx_num != m_dsc[id].rx_num_prev) {
+            /*New byte received or some bytes were read: restart the idle time*/
+            m_dsc[id].rx_num_prev = rx_num;
+            m_dsc[id].idle_cnt = 0;
+        } else if(rx_num != 0 && m_dsc[id].idle_cnt < m_dsc[id].idle_timeout) {
+            m_dsc[id].idle_cnt++;
+            if(m_dsc[id].idle_cnt == m_dsc[id].idle_timeout) cb(id, SERIAL_RX_EVT_IDLE);
+        }
+    }
+}
+#endif
+
 #endif
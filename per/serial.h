@@ -20,10 +20,18 @@
  *      DEFINES
  *********************/
 #define SERIAL_SEND_STRING  (-1)
+#define SERIAL_TX_LWM_DEF   (-1)     /*Default tx low watermark: half of the tx buffer*/
 
 /**********************
  *      TYPEDEFS
  **********************/
+typedef enum
+{
+    SERIAL_RX_EVT_THRESHOLD,    /*The set number of bytes are in the rx buffer*/
+    SERIAL_RX_EVT_IDLE,         /*No new byte was received since 'idle_timeout' ms*/
+}serial_rx_evt_t;
+
+typedef void (*serial_rx_cb_t)(serial_t id, serial_rx_evt_t evt);
 
 /**********************
  * GLOBAL PROTOTYPES
@@ -31,10 +39,16 @@
 void serial_init(void);
 hw_res_t serial_send(serial_t id, const void * tx_buf, int32_t * length);
 hw_res_t serial_send_force(serial_t id, const void * tx_buf, int32_t length);
+hw_res_t serial_sendv(serial_t id, const hw_iovec_t * iov, uint32_t iov_num);
 hw_res_t serial_rec(serial_t id, void * rx_buf, int32_t * length);
 hw_res_t serial_rec_force(serial_t id, void * rx_buf, int32_t length);
+hw_res_t serial_rec_until(serial_t id, void * rx_buf, int32_t * length, const void * delim, uint32_t delim_len);
+hw_res_t serial_peek(serial_t id, void * rx_buf, int32_t * length);
+int32_t serial_find(serial_t id, const void * pattern, uint32_t pattern_len);
 hw_res_t serial_set_baud(serial_t id, uint32_t baud);
 hw_res_t serial_clear_rx_buf(serial_t id) ;
+hw_res_t serial_set_rx_cb(serial_t id, uint32_t threshold, uint32_t idle_timeout, serial_rx_cb_t cb);
+hw_res_t serial_set_tx_lwm(serial_t id, int32_t level, void (*wait_hook)(serial_t id));
 uint32_t serial_get_send_time(uint32_t byte_num, uint32_t baud);
 
 